@@ -3,6 +3,8 @@
 #include <atomic>
 #include <map>
 #include <mutex>
+#include <set>
+#include <thread>
 
 #include "restc-cpp/restc-cpp.h"
 
@@ -12,10 +14,14 @@
 #include "k8deployer/DataDef.h"
 #include "k8deployer/Kubeconfig.h"
 #include "k8deployer/DnsProvisioner.h"
+#include "k8deployer/RequestGovernor.h"
+#include "k8deployer/StateBus.h"
+#include "k8deployer/TimerWheel.h"
 
 namespace k8deployer {
 
 class Component;
+class WatchBase;
 
 class Cluster
 {
@@ -57,6 +63,14 @@ public:
     // Get the URL to the api server in the cluster
     std::string getUrl() const;
 
+    /*! Create the client and set the clusters variables
+     *
+     * Called for all the clusters before any of them are prepared. After
+     * that, the variables don't change, so other clusters can read them
+     * from their own threads.
+     */
+    void init();
+
     std::future<void> prepare();
     std::future<void> execute();
     std::future<void> pendingWork();
@@ -69,31 +83,69 @@ public:
         return storage_.get();
     }
 
-    std::shared_future<void> getVarsReadyStage() {
-        return vars_ready_;
-    }
-
     std::shared_future<void> getDefinitionsReady() {
         return definitions_ready_;
     }
 
-    std::shared_future<void> getBasicComponentsReady() {
-        return basic_components_ready_;
-    }
+    /*! Call fn on this clusters io-thread when the components are created
+     *
+     * Can be called from any thread. Used to resolve dependencies between
+     * clusters without blocking the callers thread.
+     */
+    void whenComponentsCreated(std::function<void ()> fn);
 
     std::shared_future<void> getPreparedReady() {
         return prepared_ready_;
     }
 
+    // All mutating and probing requests to the API server goes trough the governor
+    RequestGovernor& governor() noexcept {
+        assert(governor_);
+        return *governor_;
+    }
+
+    // Polls, delays and deadlines. Only use from the io-thread.
+    TimerWheel& timers() noexcept {
+        assert(timers_);
+        return *timers_;
+    }
+
+    // State changes from components in other clusters that our components depend on
+    StateBus& stateBus() noexcept {
+        assert(stateBus_);
+        return *stateBus_;
+    }
+
+    using work_fn_t = std::function<void ()>;
+    using continuation_fn_t = std::function<void (std::exception_ptr)>;
+
+    /*! Run CPU intensive work, like serialization, on the worker-pool
+     *
+     * \param work Work to run on a worker thread. It must not touch the
+     *      state of any Component or Task.
+     * \param then Continuation, called on the io-thread when the work is
+     *      done. It gets the exception thrown by work, if any.
+     *
+     * All the Component and Task state is owned by the io-thread.
+     * If the worker-pool is disabled, both functions are called
+     * directly by the calling (io) thread.
+     */
+    void offload(work_fn_t work, continuation_fn_t then);
+
+    // Watch streams (objects we deploy, events, pods). Key is the collections url. See getObjectWatch()
+    std::map<std::string, std::unique_ptr<WatchBase>>& watches() noexcept {
+        return watches_;
+    }
+
+    bool hasWorkers() const noexcept {
+        return static_cast<bool>(workerIo_);
+    }
+
     auto& getIoService() {
       assert(client_);
       return client_->GetIoService();
     }
 
-    // Returns false if there is no such component
-    bool addStateListener(const std::string& componentName,
-                          const std::function<void (const Component& component)>& fn);
-
     void add(Component *component);
 
     Component *getComponent(const std::string& name);
@@ -102,12 +154,29 @@ public:
         return dns_.get();
     }
 
+    Component *getRootComponent() {
+        return rootComponent_.get();
+    }
+
+    // The fingerprint of a deployed object, from before we started. See fetchLiveHashes()
+    const std::string *getLiveHash(const std::string& collectionUrl, const std::string& name) const {
+        if (auto it = liveHashes_.find(collectionUrl + "/" + name); it != liveHashes_.end()) {
+            return &it->second;
+        }
+        return {};
+    }
+
     void listenForContainers();
 
 private:
     using action_fn_t = std::function<std::future<void>()>;
     void loadKubeconfig();
-    void startEventsLoop();
+    void createClient(const std::shared_ptr<boost::asio::ssl::context>& tls);
+    std::future<void> simulate();
+    std::future<void> deploy();
+    void fetchLiveHashes(const std::set<std::string>& urls, std::function<void ()> then);
+    void startEventsLoop(const std::string& ns);
+    void initVariables();
     void readDefinitions();
     void createComponents();
     void setCmds();
@@ -135,19 +204,26 @@ private:
     std::unique_ptr<ComponentDataDef> dataDef_;
     std::string verb_ = "Executing";
 
-    std::promise<void> vars_ready_pr_;
     std::promise<void> definitions_ready_pr_;
-    std::promise<void> basic_components_pr_;
     std::promise<void> prepared_ready_pr_;
 
-    std::shared_future<void> vars_ready_{vars_ready_pr_.get_future()};
     std::shared_future<void> definitions_ready_{definitions_ready_pr_.get_future()};
-    std::shared_future<void> basic_components_ready_{basic_components_pr_.get_future()};
     std::shared_future<void> prepared_ready_{prepared_ready_pr_.get_future()};
+    bool componentsCreated_ = false; // Protected by mutex_
+    std::vector<std::function<void ()>> onComponentsCreated_; // Protected by mutex_
     std::mutex mutex_;
     std::map<std::string /* container id */, k8api::ContainerStatus /* previous known state*/> knownContainers_;
     std::map<std::string /* container id */, std::string /* path */> openLogs_;
     std::shared_ptr<restc_cpp::RestClient> client_;
+    std::unique_ptr<RequestGovernor> governor_;
+    std::unique_ptr<TimerWheel> timers_;
+    std::unique_ptr<StateBus> stateBus_;
+    std::unique_ptr<boost::asio::io_service> workerIo_;
+    std::unique_ptr<boost::asio::io_service::work> workerWork_;
+    std::vector<std::thread> workers_;
+    std::map<std::string, std::unique_ptr<WatchBase>> watches_;
+    std::set<std::string> namespaces_; // Used by the components. Set after prepare.
+    std::map<std::string /* url/name */, std::string /* fingerprint */> liveHashes_;
 };
 
 
@@ -5,6 +5,7 @@
 #include <memory>
 #include <vector>
 #include <map>
+#include <set>
 #include <deque>
 #include <cassert>
 #include <sstream>
@@ -17,11 +18,17 @@
 #include "k8deployer/Engine.h"
 #include "k8deployer/logging.h"
 #include "k8deployer/DataDef.h"
+#include "k8deployer/DependencyGraph.h"
+#include "k8deployer/RequestGovernor.h"
+#include "k8deployer/StateBus.h"
+#include "k8deployer/TimerWheel.h"
 
 namespace k8deployer {
 
 class Cluster;
 class Component;
+class Scheduler;
+class EventIndex;
 
 enum class Kind {
     APP, // A placeholder that owns other components
@@ -47,10 +54,19 @@ std::string slurp (const std::string& path);
 
 Kind toKind(const std::string& kind);
 
+// Kinds that don't belong to a namespace
+bool isClusterScoped(Kind kind);
+
 const restc_cpp::JsonFieldMapping *jsonFieldMappings();
 std::string expandVariables(const std::string& json, const variables_t& vars);
 std::string execFunction(const std::string& name, const std::string& arg);
 
+// eval, intexpr and expr are evaluated by exprtk
+bool isExpressionFunction(const std::string& name);
+
+// Format the result from an expression function
+std::string execFunction(const std::string& name, double result);
+
 using input_processor_t = std::function<std::string(const std::string&)>;
 
 /*! Reads the contents from a .json or .yaml file and returns the content as json. */
@@ -82,8 +98,33 @@ std::string toJson(const T& obj) {
     return out.str();
 }
 
+template <typename T>
+struct is_optional : std::false_type {};
+
+template <typename T>
+struct is_optional<std::optional<T>> : std::true_type {};
+
+/*! Returns the metadata for a k8s object, or nullptr if it's unset */
+template <typename T>
+auto getObjectMeta(T& obj) {
+    if constexpr (is_optional<std::remove_cv_t<decltype(obj.metadata)>>::value) {
+        return obj.metadata ? &*obj.metadata : nullptr;
+    } else {
+        return &obj.metadata;
+    }
+}
+
 std::string Base64Encode(const std::string &in);
 
+// Annotation with a hash of the objects content, as we deployed it.
+constexpr auto fingerprintAnnotation = "k8dep-hash";
+
+// Add a placeholder for the fingerprint, to be replaced by stampFingerprint()
+void prepareFingerprint(k8api::ObjectMeta& meta);
+
+// Hash the serialized object and put the hash in the placeholder. Returns the hash.
+std::string stampFingerprint(std::string& json);
+
 std::future<void> dummyReturnFuture();
 
 struct PortInfo {
@@ -213,6 +254,13 @@ public:
 
         bool setState(TaskState state, bool scheduleRunTasks = true);
 
+        // Set the task in FAILED state, and log the reason
+        void fail(const std::string& reason);
+
+        const std::string& failureReason() const noexcept {
+            return failureReason_;
+        }
+
         /*! Update the state depending on current state and dependicies.
          *
          * If in BLOCKED state, the Task will change it's state to READY when
@@ -227,8 +275,13 @@ public:
             fn_(*this, {});
         }
 
-        // Schedule a new poll, unless one is already scheduled
+        // Schedule a new poll, unless one is already scheduled.
+        // The interval backs off exponentially from the components poll.initial.ms.
         void schedulePoll();
+
+        // Probe right away if a poll is scheduled, and reset the back-off.
+        // Used when an event indicates that the object has changed.
+        void pollNow();
 \
         /*! All tasks in EXECUTING or WAITING state get's the events
          *
@@ -248,26 +301,59 @@ public:
             return component_;
         }
 
-        void addDependency(const wptr_t& task);
-
-        void addAllDependencies(std::set<Task *>& tasks);
+        // Adds the dependency if it don't already exists
+        void addDependency(Task& task);
 
         bool startProbeAfterApply = false;
-        bool dontFailIfAlreadyExists = false;
+        bool dontFailIfAlreadyExists = false; // Only used when objects are POST'ed
 
-        const std::deque<wptr_t>& dependencies() const {
+        const std::vector<Task *>& dependencies() const {
             return dependencies_;
         }
 
+        // Index in the task list. Set by prepareTasks()
+        DependencyGraph::id_t id() const noexcept {
+            return id_;
+        }
+
+        // Number of dependencies that are not yet DONE
+        size_t pendingDependencies() const noexcept {
+            return pendingDependencies_;
+        }
+
+        // Seconds from the task started EXECUTING until it was DONE
+        std::optional<double> elapsed() const noexcept {
+            return elapsed_;
+        }
+
     private:
-        // All dependencies must be DONE before the task goes in READY state
-        std::deque<wptr_t> dependencies_;
+        friend class Component;
+        friend class Scheduler;
+
+        // All dependencies must be DONE before the task goes in READY state.
+        // The tasks are owned by the root component, and outlive each other.
+        std::vector<Task *> dependencies_;
+        DependencyGraph::id_t id_ = 0;
+
+        // Maintained by the Scheduler
+        size_t pendingDependencies_ = 0;
+        size_t failedDependencies_ = 0;
+        double criticalPath_ = -1.0; // Estimated seconds to the end of the longest path through the task
 
         Component& component_;
         const std::string name_;
         fn_t fn_; // What this task has to do
         TaskState state_ = TaskState::PRE;
-        std::unique_ptr<boost::asio::deadline_timer> pollTimer_;
+        TimerWheel::id_t pollTimer_ = 0;
+        std::chrono::milliseconds pollInterval_{}; // Last interval used. 0 to start over.
+        TimerWheel::id_t deadline_ = 0; // timeout.seconds
+        std::string failureReason_;
+        std::optional<std::chrono::steady_clock::time_point> executingSince_;
+        std::optional<double> elapsed_;
+
+        void startPollTimer(std::chrono::milliseconds delay);
+        void startDeadline();
+        void cancelTimers();
         const Mode mode_ = Mode::CREATE;
     };
 
@@ -277,7 +363,7 @@ public:
 
     Component(const Component::ptr_t& parent, Cluster& cluster, const ComponentData& data);
 
-    virtual ~Component() = default;
+    virtual ~Component();
 
     // When to execute a child, relative to the parent
     enum class ParentRelation {
@@ -305,6 +391,20 @@ public:
 
     std::string getArg(const std::string& name, const std::string& defaultVal) const;
     int getIntArg(const std::string& name, int defaultVal) const;
+    double getDoubleArg(const std::string& name, double defaultVal) const;
+
+    struct PollConfig {
+        std::chrono::milliseconds initial;
+        std::chrono::milliseconds max;
+        double backoff = 2.0;
+    };
+
+    /*! Intervals for polling the component's state.
+     *
+     * Each value can be set with the args `poll.initial.ms`, `poll.max.ms`
+     * and `poll.backoff`, or for a Kind, ex: `poll.StatefulSet.max.ms`.
+     */
+    PollConfig getPollConfig() const;
     size_t getSizetArg(const std::string &name, size_t defaultVal) const;
 
     Cluster& cluster() noexcept {
@@ -312,6 +412,11 @@ public:
         return *cluster_;
     }
 
+    const Cluster& cluster() const noexcept {
+        assert(cluster_);
+        return *cluster_;
+    }
+
     restc_cpp::RestClient& client() {
         return cluster().client();
     }
@@ -327,14 +432,20 @@ public:
     // Let clusters deploy themselfs in parallell
     std::future<void> deploy();
 
+    // Like deploy(), but `done` is set when the deployment is finished
+    void deploy(std::shared_ptr<std::promise<void>> done);
+
     std::future<void> dumpDependencies();
 
     // Called on the root component
     // Let clusters delete themselfs in parallell
     std::future<void> remove();
 
-    // Called on the root component
-    void onEvent(const std::shared_ptr<k8api::Event>& event);
+    // Called on the root component, with the tasks the event is routed to
+    void onEvent(const std::shared_ptr<k8api::Event>& event, std::vector<Task::wptr_t> tasks);
+
+    // The root components event index. Tasks register here to get k8s events.
+    EventIndex& getEventIndex();
 
     labels_t::value_type getSelector();
 
@@ -368,6 +479,9 @@ public:
         return false;
     }
 
+    // Make the tasks that are polling for the objects state probe right away
+    void pollNow();
+
     void schedule(std::function<void ()> fn);
     void schedule(std::function<void ()> fn, int afterSeconds);
 
@@ -387,6 +501,18 @@ public:
 
     virtual std::string getNamespace() const;
 
+    // All the namespaces used by namespaced objects in the component tree
+    std::set<std::string> getNamespaces();
+
+    // The collections (like `.../namespaces/ns/deployments`) we deploy objects to
+    std::set<std::string> getCollectionUrls();
+
+    // metadata.generation from the last apply. Probes must not accept older versions.
+    int appliedGeneration() const noexcept {
+        return appliedGeneration_;
+    }
+
+    // Starts the elapsed timer and the timeout.component.seconds deadline
     void startElapsedTimer();
 
     ptr_t addChild(const std::string& name, Kind kind, const labels_t& labels = {},
@@ -396,9 +522,16 @@ public:
         return parent_.expired();
     }
 
-    void addStateListener(const std::function<void (const Component& component)>& fn);
+    /*! Publish our state changes to the inbox of another cluster
+     *
+     * Only call from our own io-thread.
+     */
+    void addSubscriber(StateBus& bus);
 
 protected:
+    friend class Scheduler;
+    friend class Simulator;
+
     virtual std::string getCreationUrl() const {
         assert(false); // Implement!
         return {};
@@ -408,13 +541,65 @@ protected:
         return getCreationUrl() + "/" + name;
     };
 
-    void addDependenciesRecursively(std::set<Component *>& contains);
-    void processEvent(const k8api::Event& event);
+    void processEvent(const k8api::Event& event, const std::vector<Task::wptr_t>& tasks);
 
     // Recursively add tasks to the task list
     virtual void addDeploymentTasks(tasks_t& tasks);
     virtual void addRemovementTasks(tasks_t& tasks);
 
+    /*! Tasks for removing things outside the cluster, like DNS entries.
+     *
+     * Not recursive. Called by addRemovementTasks() overrides, and for
+     * each component when the objects are deleted by collection.
+     */
+    virtual void addCleanupTasks(tasks_t& /*tasks*/) {}
+
+    // A selector argument for LIST and deletecollection, like {"labelSelector", "app=nginx"}
+    using selector_t = std::pair<std::string, std::string>;
+
+    /*! Delete all the objects with our `k8dep-deployment` label, one request per collection
+     *
+     * Only for the root component. Services are deleted one by one, and
+     * namespaces after everything else.
+     */
+    void addCollectionRemovementTasks(tasks_t& tasks);
+
+    // True if all our namespaced components are in namespaces we create
+    bool ownsItsNamespaces();
+
+    /*! Delete just the namespaces, and the cluster-scoped objects
+     *
+     * Only for the root component, when ownsItsNamespaces() is true.
+     */
+    void addNamespaceRemovementTasks(tasks_t& tasks);
+
+    /*! A task that deletes `url`
+     *
+     * With a `collectionUrl`, the task is done when no objects in that
+     * collection match the selector. If `url` is the collection, this is a
+     * deletecollection.
+     */
+    Task::ptr_t makeDeleteTask(const std::string& taskName, const std::string& url,
+                               const std::string& collectionUrl = {},
+                               const selector_t& selector = {});
+
+    /*! Wait until no objects in the collection match the selector
+     *
+     * LISTs what is left, and then watches from there until all of it is
+     * DELETED. A namespace is watched as a k8api::Namespace. The LIST is
+     * retried after `delay`, with back-off, if it fails.
+     */
+    void waitForEmptyCollection(const std::string& url, const selector_t& selector,
+                                std::weak_ptr<Task> task, std::chrono::milliseconds delay);
+
+    template <typename T>
+    void watchUntilDeleted(const std::string& url, const selector_t& selector,
+                           std::weak_ptr<Task> task, std::set<std::string> remaining,
+                           const std::string& resourceVersion);
+
+    // Add the `k8dep-*` labels from the component to an objects metadata
+    void addDeploymentLabels(k8api::ObjectMeta& meta) const;
+
     static Component::ptr_t createComponent(const ComponentDataDef &def,
                                      const Component::ptr_t& parent,
                                      Cluster& cluster);
@@ -429,6 +614,7 @@ protected:
     Component * getFirstKindAmongChildren(Kind kind);
     void initChildren();
     std::future<void> execute();
+    void execute(std::shared_ptr<std::promise<void>> done);
 
     // Build the DeployTasks list for this component
     tasks_t buildDeployTasks();
@@ -472,97 +658,83 @@ protected:
         // Create the json payload here for two reasons:
         //  1) kubernetes don't seem to like chunked bodies for patch payloads
         //  2) We have no guarantee regarding the lifetime of the data object.
-        auto json = toJson(data);
+        // If the cluster has a worker-pool, the serialization is done there.
+        //
+        // Objects we create get our `k8dep-*` labels, and a fingerprint, so
+        // that they can be skipped on the next deploy if they are unchanged.
+        //
+        // With server-side apply, a POST to the collection url is sent as
+        // an apply PATCH to the objects url. See sendApplyJson().
+        auto copy = std::make_shared<T>(data);
+        std::string name;
+        const bool stamp = requestType == restc_cpp::Request::Type::POST;
+        if (auto meta = getObjectMeta(*copy); meta && stamp) {
+            addDeploymentLabels(*meta);
+            prepareFingerprint(*meta);
+            name = meta->name;
+        }
 
-        cluster_->client().Process([this, url, task, json=std::move(json), requestType](auto& ctx) {
-            std::string taskName = "***";
-            if (auto t = task.lock()) {
-                taskName = t->name();
-            }
-            LOG_DEBUG << logName() << "Applying task " << taskName << " to " << url;
-            LOG_TRACE << logName() << "Applying payload for task " << taskName << ": " << json;
-            std::string contentType = "application/json; charset=utf-8";
-            if (requestType == restc_cpp::Request::Type::PATCH) {
-                contentType = "application/merge-patch+json; charset=utf-8";
+        auto json = std::make_shared<std::string>();
+        auto hash = std::make_shared<std::string>();
+        cluster_->offload([json, hash, copy, stamp] {
+            *json = toJson(*copy);
+            if (stamp) {
+                *hash = stampFingerprint(*json);
             }
-
-            try {
-                auto reply = restc_cpp::RequestBuilder{ctx}.Req(url, requestType)
-                   .Header("Content-Type", contentType)
-                   .Data(json)
-                   .Execute();
-
-                LOG_DEBUG << logName()
-                      << "Applying task " << taskName << " gave response: "
-                      << reply->GetResponseCode() << ' '
-                      << reply->GetHttpResponse().reason_phrase;
-
+        }, [this, json, hash, url, name, task, requestType](std::exception_ptr eptr) {
+            if (eptr) {
+                LOG_ERROR << logName() << "Failed to serialize the payload to " << url;
                 if (auto t = task.lock()) {
-                    if (t->startProbeAfterApply /* && Engine::mode() != Engine::Mode::DELETE*/) {
-                        t->setState(Task::TaskState::WAITING);
-                        t->schedulePoll();
-                    } else {
-                        // Assume that tasks that don't need polling are OK after create.
-                        t->setState(Task::TaskState::DONE);
-                    }
+                    t->setState(Task::TaskState::FAILED);
                 }
-
+                setState(State::FAILED);
                 return;
-            } catch(const restc_cpp::RequestFailedWithErrorException& err) {
-                if (err.http_response.status_code == 404) {
-                    if (auto t = task.lock()) {
-                        if (t->mode() == Mode::REMOVE) {
-                            LOG_DEBUG << logName()
-                                      << "Applying REMOVE task " << taskName << " to already deleted resource. Probably ok: "
-                                      << err.http_response.status_code << ' '
-                                      << err.http_response.reason_phrase;
-                            t->setState(Task::TaskState::DONE);
-                            return;
-                        }
-                    }
-                }
+            }
 
-                if (err.http_response.status_code == 409) {
+            if (!hash->empty()) {
+                if (auto live = cluster_->getLiveHash(url, name); live && *live == *hash) {
+                    LOG_INFO << logName() << "Unchanged since the last deploy. Skipping.";
                     if (auto t = task.lock()) {
-                        if (t->mode() == Mode::CREATE && t->dontFailIfAlreadyExists) {
-                            LOG_DEBUG << logName()
-                                      << "Applying task " << taskName << " to existing resource. Probably ok: "
-                                      << err.http_response.status_code << ' '
-                                      << err.http_response.reason_phrase;
-                            t->setState(Task::TaskState::DONE);
-                            return;
-                        }
+                        t->setState(Task::TaskState::DONE);
                     }
+                    return;
                 }
-
-                LOG_WARN << logName()
-                         << "Apply task " << taskName << ": Request failed: " << err.http_response.status_code
-                         << ' ' << err.http_response.reason_phrase
-                         << ": " << err.what();
-
-            } catch(const std::exception& ex) {
-                LOG_WARN << logName()
-                         << "Apply task " << taskName << ": Request failed: " << ex.what();
-            }
-
-            if (auto taskInstance = task.lock()) {
-                taskInstance->setState(Task::TaskState::FAILED);
             }
-            setState(State::FAILED);
 
+            sendApplyJson(std::move(*json), url, task, requestType, name);
         });
     }
 
+    // `name` is the objects name, used for server-side apply
+    void sendApplyJson(std::string json, const std::string& url, std::weak_ptr<Task> task,
+                       const restc_cpp::Request::Type requestType,
+                       const std::string& name = {});
+
     void sendDelete(const std::string& url, std::weak_ptr<Component::Task> task,
                     bool ignoreErrors = false,
-                    const std::initializer_list<std::pair<std::string, std::string>>& args = {});
+                    std::vector<std::pair<std::string, std::string>> args = {});
+
+    // DELETE with propagationPolicy=Background. See makeDeleteTask()
+    void sendDeleteAndWait(const std::string& url, const std::string& collectionUrl,
+                           const selector_t& selector, std::weak_ptr<Component::Task> task);
 
     void calculateElapsed();
     //void addDependencyToNamespace();
 
+    // The root components scheduler, if it is created
+    Scheduler *getScheduler();
+
     // Adds the dependency if it don't already exists
     void addDependency(Component& component);
-    static void prepareTasks(tasks_t& tasks, bool reverseDependencies);
+
+    /*! Add the parent relations, and check the tasks for circular dependencies
+     *
+     * \return The task graph. The nodes are the indexes in tasks.
+     */
+    static DependencyGraph prepareTasks(tasks_t& tasks, bool reverseDependencies);
+
+    // Check all the components for circular dependencies. Called once on the root.
+    void checkForCircularDependencies();
 
     /*! Return the App component that owns this component
      */
@@ -577,10 +749,14 @@ protected:
     conf_t effectiveArgs_;
     childrens_t children_;
     std::unique_ptr<tasks_t> tasks_;
-    std::unique_ptr<std::promise<void>> executionPromise_;
-    std::vector<std::weak_ptr<Component>> dependsOn_;
+    std::vector<Task *> ownTasks_; // This components tasks. Indexed by prepareTasks()
+    std::unique_ptr<Scheduler> scheduler_;
+    std::unique_ptr<EventIndex> eventIndex_;
+    std::shared_ptr<std::promise<void>> executionPromise_;
+    std::vector<Component *> dependsOn_; // Components live as long as the root
+    std::vector<Component *> dependents_; // Components that depend on this one
     std::vector<std::unique_ptr<DependencyReference>> clusterDependencies_;
-    std::vector<std::function<void (const Component& component)>> stateListeners_;
+    std::vector<StateBus *> subscribers_; // Inboxes in other clusters. Only used from our io-thread
     Mode mode_ = Mode::CREATE;
     std::optional<std::chrono::steady_clock::time_point> startTime;
     std::optional<double> elapsed = {};
@@ -588,6 +764,8 @@ protected:
     std::optional<bool> delayBeforeTimerExceuted_;
     std::optional<bool> delayAfterTimerExceuted_;
     std::optional<bool> delaySequenceTimerExceuted_;
+    TimerWheel::id_t deadline_ = 0; // timeout.component.seconds
+    int appliedGeneration_ = 0;
 };
 
 } // ns
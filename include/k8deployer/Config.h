@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <map>
@@ -35,6 +36,22 @@ struct Config {
   std::string webBrowser;
   std::string pvcStorageClassName;
   bool ignoreResourceLimits = false;
+  size_t maxRequestsInFlight = 64; // Per cluster
+  int requestLatencyThresholdMs = 2000;
+  size_t workerThreads = 0; // Per cluster. 0 to do all the work on the io-thread
+  bool watchObjects = true;
+  std::string eventsFieldSelector; // Ex: involvedObject.kind=Pod
+  int watchTimeoutSeconds = 60;
+  int taskTimeoutSeconds = 0; // Default for the timeout.seconds arg. 0 to wait forever
+  std::string simModel; // Latency model for `simulate`
+  uint64_t simSeed = 1;
+  size_t simRuns = 1;
+  std::string saveTimings; // Save the elapsed times after `deploy`, for `simulate`
+  bool skipUnchanged = true;
+  bool serverSideApply = true; // Create and update with PATCH application/apply-patch+yaml
+  bool forceApply = false; // Take over fields owned by other field managers
+  std::string deleteMode = "auto"; // auto | objects | collection | namespace
+  std::string cacheDir; // Cache for the parsed definition and kubeconfigs. Empty to disable
 };
 
 } // ns
@@ -80,3 +80,48 @@ struct ComponentDataDef : public ComponentData {
 };
 
 } // ns
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::StorageDef,
+    (k8deployer::k8api::VolumeMount, volume)
+    (std::string, capacity)
+    (bool, createVolume)
+    (std::string, chownUser)
+    (std::string, chownGroup)
+    (std::string, chmodMode)
+);
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::ComponentDataDef,
+    // ComponentData
+    (std::string, name)
+    (std::string, variant)
+    (bool, enabled)
+    (k8deployer::labels_t, labels)
+    (k8deployer::conf_t, defaultArgs)
+    (k8deployer::conf_t, args)
+    (k8deployer::k8api::string_list_t, depends)
+    (k8deployer::k8api::Job, job)
+    (k8deployer::k8api::Deployment, deployment)
+    (k8deployer::k8api::StatefulSet, statefulSet)
+    (k8deployer::k8api::DaemonSet, daemonset)
+    (k8deployer::k8api::Service, service)
+    (std::optional<k8deployer::k8api::Secret>, secret)
+    (k8deployer::k8api::PersistentVolume, persistentVolume)
+    (k8deployer::k8api::Ingress, ingress)   
+    (k8deployer::k8api::Namespace, namespace_)
+    (k8deployer::k8api::Role, role)
+    (k8deployer::k8api::ClusterRole, clusterrole)
+    (k8deployer::k8api::RoleBinding, rolebinding)
+    (k8deployer::k8api::ClusterRoleBinding, clusterrolebinding)
+    (k8deployer::k8api::ServiceAccount, serviceaccount)
+    (std::optional<k8deployer::k8api::SecurityContext>, podSecurityContext)
+    (std::optional<k8deployer::k8api::PodSecurityContext>, podSpecSecurityContext)
+    (std::optional<k8deployer::k8api::Probe>, startupProbe)
+    (std::optional<k8deployer::k8api::Probe>, livenessProbe)
+    (std::optional<k8deployer::k8api::Probe>, readinessProbe)
+    (std::vector<k8deployer::StorageDef>, storage)
+
+    // ComponentDataDef
+    (std::string, kind)
+    (std::string, parentRelation)
+    (k8deployer::ComponentDataDef::childrens_t, children)
+);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "k8deployer/DataDef.h"
+#include "k8deployer/FileCache.h"
+#include "k8deployer/MacroTemplate.h"
+
+namespace k8deployer {
+
+/*! The definition file, parsed once and shared by all the clusters
+ *
+ * A yaml definition is converted to json up front. The scalars with
+ * macros (`${...}` or `$fn(...)`) are compiled and kept as slots between
+ * literal json spans, so instantiating it for a cluster is just to expand
+ * the slots with the clusters variables and join the spans.
+ *
+ * Clusters that end up with the same json share one deserialized
+ * ComponentDataDef.
+ *
+ * If the macros are not all inside yaml scalars (for example in a
+ * comment, or so that the raw file is not valid yaml), or if the
+ * definition is json, each instantiation expands the raw text like
+ * before.
+ *
+ * With a cache, both the parsed template and the deserialized instances
+ * are cached on their content, so a warm start don't parse yaml or json.
+ *
+ * instantiate() can be called from any thread.
+ */
+class DefinitionTemplate
+{
+public:
+    explicit DefinitionTemplate(std::string path, const FileCache *cache = nullptr);
+
+    // Returns a copy the caller can modify
+    std::unique_ptr<ComponentDataDef> instantiate(const variables_t& vars) const;
+
+    // True if the yaml was parsed into the template
+    bool isParsed() const noexcept {
+        return !literals_.empty();
+    }
+
+private:
+    struct Slot {
+        std::string value; // The scalar
+        MacroTemplate macros;
+        bool plain = false;
+        bool isKey = false;
+    };
+
+    void parse();
+    bool loadParsed(const std::string& key);
+    void storeParsed(const std::string& key) const;
+
+    // The json, or the expanded raw text if the yaml is not parsed
+    std::string expand(const variables_t& vars) const;
+    std::string toJson(const std::string& expanded) const;
+    void appendSlot(std::string& out, const Slot& slot, const variables_t& vars) const;
+
+    const std::string path_;
+    const FileCache *cache_ = nullptr;
+    bool isYaml_ = false;
+    std::string raw_;
+    MacroTemplate rawMacros_; // Only used if the yaml is not parsed
+    std::vector<std::string> literals_; // One more than slots_
+    std::vector<Slot> slots_;
+    mutable std::mutex mutex_;
+    mutable std::map<std::string /* expanded */, std::shared_ptr<const ComponentDataDef>> instances_;
+};
+
+} // ns
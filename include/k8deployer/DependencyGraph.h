@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace k8deployer {
+
+/*! Directed graph over flat node id's
+ *
+ * The edges are stored in CSR form; the targets for all the nodes in one
+ * contiguous vector, and an offset per node into it. Used for the tasks
+ * and components, where an edge goes from a dependency to the node that
+ * depends on it.
+ *
+ * The graph is immutable after it's built.
+ */
+class DependencyGraph
+{
+public:
+    using id_t = uint32_t;
+    using edge_t = std::pair<id_t /* from */, id_t /* to */>;
+
+    struct Range {
+        const id_t *begin() const noexcept {
+            return begin_;
+        }
+
+        const id_t *end() const noexcept {
+            return end_;
+        }
+
+        size_t size() const noexcept {
+            return static_cast<size_t>(end_ - begin_);
+        }
+
+        const id_t *begin_ = {};
+        const id_t *end_ = {};
+    };
+
+    DependencyGraph() = default;
+    DependencyGraph(size_t nodes, const std::vector<edge_t>& edges);
+
+    size_t size() const noexcept {
+        return offsets_.empty() ? 0 : offsets_.size() - 1;
+    }
+
+    // The nodes that `node` has edges to
+    Range edges(id_t node) const noexcept {
+        const auto data = targets_.data();
+        return {data + offsets_[node], data + offsets_[node + 1]};
+    }
+
+    /*! Kahn's algorithm
+     *
+     * \return The nodes, so that a node comes before all the nodes it
+     *      has edges to. Nodes on a cycle, or after one, are left out.
+     */
+    std::vector<id_t> sortTopologically() const;
+
+    // Returns a node on a cycle, if there are any
+    std::optional<id_t> findCycle() const;
+
+private:
+    std::vector<id_t> offsets_; // size() + 1 entries
+    std::vector<id_t> targets_;
+};
+
+} // ns
@@ -5,6 +5,8 @@
 #include "restc-cpp/restc-cpp.h"
 #include "k8deployer/Config.h"
 #include "k8deployer/Cluster.h"
+#include "k8deployer/DefinitionTemplate.h"
+#include "k8deployer/FileCache.h"
 
 namespace k8deployer {
 
@@ -16,7 +18,9 @@ public:
     enum class Mode {
         DEPLOY,
         DELETE,
-        SHOW_DEPENDENCIES
+        SHOW_DEPENDENCIES,
+        SIMULATE,
+        UPDATE
     };
 
     Engine(const Config& config);
@@ -37,19 +41,38 @@ public:
         return instance().mode_;
     }
 
+    // True if we are creating or updating objects in the cluster(s)
+    static bool isApplying() noexcept {
+        return mode() == Mode::DEPLOY || mode() == Mode::UPDATE;
+    }
+
     Cluster *getCluster(size_t ix);
 
     static std::tuple<bool, size_t, std::string> parseClusterVar(const std::string& name);
 
     std::string getClusterVar(size_t clusterIx, const std::string& varName);
 
+    // The definition file, shared by all the clusters
+    const DefinitionTemplate& definition() const noexcept {
+        assert(definition_);
+        return *definition_;
+    }
+
+    // nullptr unless --cache-dir is set
+    const FileCache *cache() const noexcept {
+        return cache_.get();
+    }
+
 private:
     void startPortForwardig();
+    void saveTimings();
 
     const Config cfg_;
     static Engine *instance_;
     Mode mode_ = Mode::DEPLOY;
     std::vector<std::unique_ptr<Cluster>> clusters_;
+    std::unique_ptr<DefinitionTemplate> definition_;
+    std::unique_ptr<FileCache> cache_;
 };
 
 } // ns
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "k8deployer/Component.h"
+
+namespace k8deployer {
+
+/*! Routes k8s events to the tasks that want them
+ *
+ * Tasks register interest in events for an object, identified by it's
+ * kind, namespace and name, or for all objects of a kind with names
+ * starting with a prefix (like the pods owned by a Deployment).
+ *
+ * Prefixes must end with a '-', so a lookup only needs to check the
+ * parts of the name up to each '-'.
+ *
+ * Only accessed from the clusters io-thread.
+ */
+class EventIndex
+{
+public:
+    using tasks_t = std::vector<Component::Task::wptr_t>;
+
+    void add(const std::string& kind, const std::string& ns, const std::string& name,
+             const Component::Task::wptr_t& task);
+
+    void addPrefix(const std::string& kind, const std::string& ns, const std::string& prefix,
+                   const Component::Task::wptr_t& task);
+
+    // Get the tasks that registered interest in the events involved object.
+    tasks_t lookup(const k8api::Event& event) const;
+
+    bool empty() const noexcept {
+        return exact_.empty() && prefixes_.empty();
+    }
+
+private:
+    static std::string key(const std::string& kind, const std::string& ns, const std::string& name);
+    static void append(tasks_t& tasks, const tasks_t& add);
+
+    std::unordered_map<std::string, tasks_t> exact_;
+    std::unordered_map<std::string, tasks_t> prefixes_;
+};
+
+} // ns
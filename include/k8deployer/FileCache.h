@@ -0,0 +1,71 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include "k8deployer/binary_fn.h"
+
+namespace k8deployer {
+
+/*! Content-addressed cache for the deserialized input files
+ *
+ * An entry is keyed on the sha256 of what it was made from, the layout of
+ * the type it holds and the k8deployer version, so a changed file, a
+ * changed struct or a new version is just a miss.
+ * The objects are stored in the format from binary_fn.h, and the files
+ * are memory-mapped when they are read.
+ *
+ * Entries are written to a temporary file that is renamed in place, so
+ * several instances can share the directory. A broken entry is treated
+ * as a miss and replaced. The entries may contain credentials from the
+ * kubeconfigs, so they, and the directory, are only accessible by the owner.
+ */
+class FileCache
+{
+public:
+    explicit FileCache(std::filesystem::path dir);
+
+    // Key for the entry of the given kind, holding a T, made from content
+    template <typename T>
+    static std::string key(std::string_view kind, std::string_view content) {
+        return key(kind, binaryLayout<T>(), content);
+    }
+
+    static std::string key(std::string_view kind, std::string_view layout,
+                           std::string_view content);
+
+    // Returns false if the entry don't exist or is invalid
+    template <typename T>
+    bool load(const std::string& key, T& obj) const {
+        return read(key, [&](std::string_view data) {
+            T tmp;
+            fromBinary(tmp, data);
+            if (!data.empty()) {
+                throw std::runtime_error("Trailing data");
+            }
+            obj = std::move(tmp);
+        });
+    }
+
+    template <typename T>
+    void store(const std::string& key, const T& obj) const {
+        std::string data;
+        toBinary(obj, data);
+        write(key, data);
+    }
+
+    // Calls fn with the mapped data. fn may throw if the data is invalid.
+    bool read(const std::string& key, const std::function<void(std::string_view data)>& fn) const;
+
+    // Errors are logged, but not thrown
+    void write(const std::string& key, const std::string& data) const;
+
+private:
+    std::filesystem::path pathOf(const std::string& key) const;
+
+    const std::filesystem::path dir_;
+};
+
+} // ns
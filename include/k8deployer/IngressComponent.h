@@ -21,6 +21,7 @@ public:
 protected:
     void addDeploymentTasks(tasks_t& tasks) override;
     void addRemovementTasks(tasks_t &tasks) override;
+    void addCleanupTasks(tasks_t &tasks) override;
 
 private:
     void doDeploy(std::weak_ptr<Task> task);
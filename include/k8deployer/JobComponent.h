@@ -19,6 +19,7 @@ public:
 
 protected:
     void addRemovementTasks(tasks_t &tasks) override;
+    std::string getCreationUrl() const override;
 
     k8api::ObjectMeta *getMetadata() override {
         return &job.metadata;
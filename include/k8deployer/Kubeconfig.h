@@ -7,6 +7,8 @@
 
 namespace k8deployer {
 
+class FileCache;
+
 class Kubeconfig
 {
 public:
@@ -23,10 +25,13 @@ public:
      *     - If KUBECONFIG environemnt vbariable is set, use that
      *     - Try ~/.kube/config
      *
+     *     If cache is set, the parsed config is cached on the content of the file.
+     *
      *     @return pointer if config was found.
      *     @throws std::runtime_error if the config was not available or invalid
      */
-    static std::unique_ptr<Kubeconfig> load(const std::string& kubefile);
+    static std::unique_ptr<Kubeconfig> load(const std::string& kubefile,
+                                            const FileCache *cache = nullptr);
 
     struct ClusterData
     {
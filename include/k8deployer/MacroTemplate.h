@@ -0,0 +1,76 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "k8deployer/DataDef.h"
+
+namespace k8deployer {
+
+/*! Text with macros, compiled once
+ *
+ * The text is split into literal spans, variables (`${name[,default]}`)
+ * and functions (`$name(arg)`). Default values and function arguments
+ * are compiled recursively. Cluster references (`cluster1:name`) are
+ * resolved when the template is compiled, so expand() don't parse
+ * anything.
+ *
+ * Variables are looked up in the variables, then in the environment
+ * (a snapshot taken the first time it's used), then the default value
+ * is used.
+ *
+ * In the expression functions ($eval, $expr, $intexpr) the macros are
+ * bound as variables in a cached, compiled exprtk expression, as long as
+ * they expand to numbers. Otherwise the argument is expanded as text.
+ *
+ * Immutable after it's compiled, so it can be shared between threads.
+ */
+class MacroTemplate
+{
+public:
+    MacroTemplate() = default;
+
+    // throws runtime_error if the macros are not properly terminated
+    explicit MacroTemplate(const std::string& text);
+
+    std::string expand(const variables_t& vars) const;
+
+    // True if there are no variables or functions in the text
+    bool isLiteral() const noexcept {
+        return spans_.empty() || (spans_.size() == 1 && spans_.front().type == Span::Type::LITERAL);
+    }
+
+    // Snapshot of the environment variables
+    static const std::unordered_map<std::string, std::string>& environment();
+
+private:
+    struct Span {
+        enum class Type {
+            LITERAL,
+            VARIABLE,
+            FUNCTION
+        };
+
+        Type type = Type::LITERAL;
+        std::string text; // The literal, variable name or function name
+        std::shared_ptr<const MacroTemplate> arg; // Default value or function argument
+        bool isClusterVar = false;
+        size_t clusterIx = 0;
+        std::string clusterVarName;
+        std::string expression; // The exprtk expression with variables for the macros, if possible
+    };
+
+    void addLiteral(const std::string& text);
+    void addVariable(const std::string& name, const std::string *defaultValue);
+    void addFunction(const std::string& name, const std::string& arg);
+    std::string expand(const Span& span, const variables_t& vars) const;
+    std::string getVar(const Span& span, const variables_t& vars) const;
+    std::string evalExpression(const Span& span, const variables_t& vars) const;
+    std::string toExpression() const;
+
+    std::vector<Span> spans_;
+};
+
+} // ns
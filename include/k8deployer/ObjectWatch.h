@@ -0,0 +1,104 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "k8deployer/Cluster.h"
+#include "k8deployer/Component.h"
+#include "k8deployer/Watch.h"
+#include "k8deployer/logging.h"
+
+namespace k8deployer {
+
+// The kinds we track with watches. Other kinds are probed with GET requests.
+template <typename T> struct IsWatched : std::false_type {};
+template <> struct IsWatched<k8api::Deployment> : std::true_type {};
+template <> struct IsWatched<k8api::StatefulSet> : std::true_type {};
+template <> struct IsWatched<k8api::DaemonSet> : std::true_type {};
+template <> struct IsWatched<k8api::Job> : std::true_type {};
+template <> struct IsWatched<k8api::PersistentVolume> : std::true_type {};
+
+/*! Watch for one kind of objects in a namespace (or cluster-wide)
+ *
+ * Keeps a cache with the last known version of the objects with our
+ * `k8dep-deployment` label, so that probes can be answered without
+ * sending a request to the API server. When an object is changed,
+ * the component that probed for it is asked to probe again.
+ *
+ * The cache is rebuilt from scratch if the watch has to re-list.
+ *
+ * The cache is only accessed from the clusters io-thread.
+ */
+template <typename T>
+class ObjectWatch : public WatchBase
+{
+public:
+    ObjectWatch(Cluster& cluster, std::string url, std::string labelSelector)
+        : cluster_{cluster}, url_{url}
+        , watch_{cluster, std::move(url), {{"labelSelector", std::move(labelSelector)}},
+                 [this](const WatchEvent<T>& event) { onEvent(event); },
+                 [this] { objects_.clear(); }}
+    {}
+
+    void start() override {
+        watch_.start();
+    }
+
+    // Last known version of the object, or nullptr if we have not seen it.
+    const T *get(const std::string& name) const {
+        if (auto it = objects_.find(name); it != objects_.end()) {
+            return &it->second;
+        }
+        return {};
+    }
+
+    // Ask the component to probe again when the object changes
+    void addInterest(const std::string& name, const std::weak_ptr<Component>& component) {
+        interested_[name] = component;
+    }
+
+private:
+    void onEvent(const WatchEvent<T>& event) {
+        auto meta = getObjectMeta(event.object);
+        if (!meta) {
+            return;
+        }
+
+        LOG_TRACE << cluster_.name() << " Watch on " << url_ << ": "
+                  << event.type << ' ' << meta->name;
+
+        if (event.type == "DELETED") {
+            objects_.erase(meta->name);
+        } else {
+            objects_[meta->name] = event.object;
+        }
+
+        if (auto it = interested_.find(meta->name); it != interested_.end()) {
+            if (auto component = it->second.lock()) {
+                component->pollNow();
+            }
+        }
+    }
+
+    Cluster& cluster_;
+    const std::string url_;
+    std::map<std::string, T> objects_;
+    std::map<std::string, std::weak_ptr<Component>> interested_;
+    Watch<T> watch_;
+};
+
+/*! Get or start the watch for a collection, like `.../namespaces/ns/deployments` */
+template <typename T>
+ObjectWatch<T>& getObjectWatch(Cluster& cluster, const std::string& url,
+                               const std::string& labelSelector) {
+    auto& watch = cluster.watches()[url];
+    if (!watch) {
+        watch = std::make_unique<ObjectWatch<T>>(cluster, url, labelSelector);
+        watch->start();
+    }
+
+    return static_cast<ObjectWatch<T>&>(*watch);
+}
+
+} // ns
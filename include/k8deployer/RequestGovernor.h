@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cassert>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include <boost/asio.hpp>
+
+#include "restc-cpp/restc-cpp.h"
+#include "restc-cpp/RequestBuilder.h"
+
+namespace k8deployer {
+
+/*! Adaptive concurrency control for the requests to a clusters API server.
+ *
+ * The number of requests allowed in flight (the window) is adjusted
+ * with AIMD (additive increase, multiplicative decrease). Each successful
+ * request increase the window by 1/window. The window is halved if
+ * the API server throttles us (429 Too Many Requests), or if the
+ * latency for a request exceeds the threshold.
+ *
+ * Requests that don't fit in the window are queued, and started as
+ * other requests complete. Throttled requests are re-queued and retried
+ * after the delay in the Retry-After header, or if there is none, after
+ * an exponential back-off, so the tasks that sent them don't fail.
+ */
+class RequestGovernor
+{
+public:
+    using fn_t = std::function<void (restc_cpp::Context& ctx)>;
+    using clock_t = std::chrono::steady_clock;
+
+    // Thrown by execute() if the API server throttles the request
+    struct ThrottledException : public restc_cpp::RequestFailedWithErrorException {
+        ThrottledException(const restc_cpp::HttpResponse& response,
+                           std::optional<std::chrono::seconds> retryAfter)
+            : RequestFailedWithErrorException(response), retryAfter{retryAfter} {}
+
+        const std::optional<std::chrono::seconds> retryAfter;
+    };
+
+    RequestGovernor(restc_cpp::RestClient& client, std::string name,
+                    size_t maxInFlight, std::chrono::milliseconds latencyThreshold,
+                    const restc_cpp::Request::Properties& properties);
+
+    /*! Process a request via the rest client when there is room for it.
+     *
+     * If the request is throttled by the API server, \a fn must let the
+     * restc_cpp::RequestFailedWithErrorException propagate (see isThrottled()),
+     * in which case \a fn will be called again later.
+     */
+    void process(fn_t fn);
+
+    /*! Execute a request from \a fn
+     *
+     * restc_cpp don't give us the reply headers when it throws on a http error,
+     * so the request is executed with throwOnHttpError off, and the error is
+     * thrown from here. A throttled request throws ThrottledException, with the
+     * Retry-After delay if the server sent it.
+     *
+     * \throws restc_cpp::RequestFailedWithErrorException if the request failed
+     */
+    std::unique_ptr<restc_cpp::Reply> execute(restc_cpp::RequestBuilder& builder) const;
+
+    static bool isThrottled(const restc_cpp::RequestFailedWithErrorException& err) noexcept {
+        return err.http_response.status_code == 429;
+    }
+
+    size_t inFlight() const noexcept {
+        return inFlight_;
+    }
+
+    size_t queued() const noexcept {
+        return queue_.size();
+    }
+
+private:
+    void start(fn_t fn);
+    void onCompleted(clock_t::duration latency);
+    void onThrottled(fn_t fn, std::optional<std::chrono::seconds> retryAfter);
+
+    // Must be called with mutex_ locked. Returns the requests to start.
+    std::deque<fn_t> takeRunnable();
+    void startAll(std::deque<fn_t> runnable);
+    void setResumeTimer(clock_t::duration delay);
+
+    restc_cpp::RestClient& client_;
+    const std::string name_;
+    const size_t maxInFlight_;
+    const std::chrono::milliseconds latencyThreshold_;
+    const restc_cpp::Request::Properties::ptr_t requestProperties_;
+    double window_;
+    size_t inFlight_ = 0;
+    unsigned throttled_ = 0; // Number of times we were throttled in a row
+    std::deque<fn_t> queue_;
+    clock_t::time_point holdUntil_ = {};
+    clock_t::time_point lastDecrease_ = {};
+    boost::asio::deadline_timer timer_;
+    bool timerPending_ = false;
+    std::mutex mutex_;
+};
+
+} // ns
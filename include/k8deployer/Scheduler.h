@@ -0,0 +1,128 @@
+#pragma once
+
+#include <deque>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <unordered_set>
+#include <vector>
+
+#include "k8deployer/Component.h"
+
+namespace k8deployer {
+
+/*! Event-driven scheduler for the tasks owned by the root component.
+ *
+ * Instead of evaluating all the components and all the tasks each time
+ * something changes, the scheduler keeps track of what was affected by a
+ * state-change, and only re-evaluates that. Each task has a counter of
+ * unfinished dependencies that is updated when a dependency changes state,
+ * so a task can be moved to the ready-queue without scanning it's
+ * dependencies.
+ *
+ * READY tasks are executed in order of their critical path; the estimated
+ * time from when the task starts until the end of the longest chain of
+ * tasks depending on it. That way slow chains (like StatefulSet -> Service
+ * -> Ingress) are started first.
+ *
+ * All methods must be called from the clusters io thread.
+ */
+class Scheduler
+{
+public:
+    using Task = Component::Task;
+
+    /*! Constructor
+     *
+     * \param tasks All the tasks
+     * \param graph The tasks dependencies, from prepareTasks()
+     */
+    Scheduler(const Component::tasks_t& tasks, DependencyGraph graph);
+
+    // Queue the component (and optionally it's tasks) for evaluation
+    void touch(Component& component, bool includeTasks = false);
+
+    // Queue the task for evaluation
+    void touch(Task& task);
+
+    // Queue the task for execution
+    void setReady(Task& task);
+
+    // Estimated duration for the components tasks, in seconds
+    static double estimatedDuration(const Component& component);
+
+    Component *nextComponent();
+    Task *nextTask();
+    Task *nextReady();
+
+    // Called when a task change state
+    void onStateChanged(Task& task, Task::TaskState from, Task::TaskState to);
+
+    // Called when a component change state
+    void onStateChanged(Component& component);
+
+    // True if runTasks() is already posted to the io thread
+    bool runPending = false;
+
+private:
+    template <typename T>
+    struct Queue {
+        bool push(T *item) {
+            if (queued.insert(item).second) {
+                items.push_back(item);
+                return true;
+            }
+            return false;
+        }
+
+        T *pop() {
+            if (items.empty()) {
+                return {};
+            }
+            auto item = items.front();
+            items.pop_front();
+            queued.erase(item);
+            return item;
+        }
+
+        std::deque<T *> items;
+        std::unordered_set<T *> queued;
+    };
+
+    // Highest critical path first. FIFO for tasks with the same priority.
+    struct ReadyQueue {
+        using item_t = std::tuple<double, uint64_t, Task *>;
+
+        bool push(Task *task) {
+            if (queued.insert(task).second) {
+                items.emplace(task->criticalPath_, --seq, task);
+                return true;
+            }
+            return false;
+        }
+
+        Task *pop() {
+            if (items.empty()) {
+                return {};
+            }
+            auto task = std::get<Task *>(items.top());
+            items.pop();
+            queued.erase(task);
+            return task;
+        }
+
+        std::priority_queue<item_t> items;
+        std::unordered_set<Task *> queued;
+        uint64_t seq = std::numeric_limits<uint64_t>::max();
+    };
+
+    void calculateCriticalPaths();
+
+    const DependencyGraph graph_; // Edges from each task to the tasks depending on it
+    std::vector<Task *> byId_;
+    Queue<Component> components_;
+    Queue<Task> tasks_;
+    ReadyQueue ready_;
+};
+
+} // ns
@@ -14,6 +14,7 @@ public:
 protected:
     void addDeploymentTasks(tasks_t& tasks) override;
     void addRemovementTasks(tasks_t &tasks) override;
+    std::string getCreationUrl() const override;
 
 private:
     void doDeploy(std::weak_ptr<Task> task);
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "k8deployer/Component.h"
+
+namespace k8deployer {
+
+/*! Predicts how long a deployment will take, without touching the cluster
+ *
+ * Uses the components and tasks from the real prepare() and prepareTasks(),
+ * and plays the deployment on a simulated clock. The time it takes for a
+ * task to complete comes from a latency model, keyed on the task, or the
+ * components name or Kind. Kinds not in the model use the same estimates as the
+ * Scheduler (the `estimate.seconds` arg or the Kinds default).
+ *
+ * The rules for when things can start mirror the components state machine:
+ * - A component starts when the components it depends on, and it's children
+ *   with parentRelation `before`, are done. Then `delay.before` and
+ *   `delay.sequence` are added.
+ * - A task starts when it's component has started and the tasks it depends
+ *   on are done.
+ * - A component is done when it's tasks and children are done. Then
+ *   `delay.after` is added.
+ *
+ * Tasks are never limited by concurrency, just like in a real deployment.
+ * Cross-cluster dependencies are ignored.
+ */
+class Simulator
+{
+public:
+    struct Distribution {
+        enum class Type {
+            FIXED,
+            UNIFORM,
+            NORMAL,
+            LOGNORMAL,
+            EXPONENTIAL
+        };
+
+        Type type = Type::FIXED;
+        double a = 0.0; // value, min or mean
+        double b = 0.0; // max or standard deviation
+
+        double sample(std::mt19937_64& rnd) const;
+    };
+
+    // Key is a Kind, like `Deployment`, `component:name` or `task:component/task`
+    using model_t = std::map<std::string, Distribution>;
+
+    Simulator(Component& root, model_t model, uint64_t seed);
+
+    /*! Load a latency model
+     *
+     * One line for each Kind or component:
+     *   Deployment  normal 20 5
+     *   component:mysql fixed 42.5
+     *
+     * Distributions: `fixed value`, `uniform min max`, `normal mean stddev`,
+     * `lognormal mean stddev`, `exponential mean`. Empty lines and lines
+     * starting with `#` are ignored.
+     */
+    static model_t loadModel(const std::string& path);
+
+    /*! Write the elapsed times from a deployment as a latency model
+     *
+     * The time for each task is from it started EXECUTING until it was DONE.
+     * The components delays and the time waiting for children are not
+     * included, since the simulation adds them.
+     */
+    static void saveTimings(Component& root, std::ostream& out);
+
+    // The key for a task in the model
+    static std::string taskKey(const Component& component, const Component::Task& task);
+
+    // Run the simulation `runs` times and log the results
+    void run(size_t runs);
+
+private:
+    struct Node {
+        enum class Type {
+            START,
+            TASK,
+            DONE
+        };
+
+        Type type = Type::TASK;
+        Component *component = {};
+        Component::Task *task = {};
+        std::vector<size_t> dependents;
+        size_t numDependencies = 0;
+
+        // Per run
+        size_t pending = 0;
+        double duration = 0.0;
+        double started = -1.0;
+        double done = -1.0;
+        int cause = -1; // The dependency that finished last
+    };
+
+    struct Result {
+        double makespan = 0.0;
+        size_t peakConcurrency = 0;
+    };
+
+    void build();
+    size_t add(Node::Type type, Component *component, Component::Task *task = {});
+    void addDependency(size_t node, size_t dependency);
+    double duration(const Node& node);
+    Result simulate();
+    void report(const Result& result) const;
+    std::string describe(const Node& node) const;
+
+    Component& root_;
+    const model_t model_;
+    std::mt19937_64 rnd_;
+    std::vector<Node> nodes_;
+    std::map<const Component *, size_t> starts_;
+    std::map<const Component *, size_t> dones_;
+    std::map<const Component::Task *, size_t> tasks_;
+};
+
+} // ns
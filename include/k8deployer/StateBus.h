@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace k8deployer {
+
+class Cluster;
+class Component;
+
+/*! Inbox for state changes in components in other clusters
+ *
+ * Each cluster has one. A component publishes a state change once to the
+ * inbox of each cluster that has subscribers for it. Publishing is a
+ * lock-free push to a singly linked list, and can be done from any thread.
+ *
+ * The push that makes the inbox non-empty posts one drain to the owning
+ * clusters io-thread. The drain takes the whole batch, calls the
+ * subscribers in the order the changes was published, and then schedules
+ * the affected components once.
+ *
+ * The subscriptions are only accessed from the owning io-thread.
+ */
+class StateBus
+{
+public:
+    using state_t = int; // Component::State
+    using fn_t = std::function<void (state_t state)>;
+
+    StateBus(boost::asio::io_service& io);
+    ~StateBus();
+
+    StateBus(const StateBus&) = delete;
+    StateBus& operator = (const StateBus&) = delete;
+
+    /*! Call fn when the component `name` in `source` changes state
+     *
+     * Only call from the owning io-thread.
+     */
+    void subscribe(const Cluster& source, const std::string& name,
+                   Component& subscriber, fn_t fn);
+
+    // Called from the publishers io-thread
+    void publish(const Component& source, state_t state);
+
+private:
+    struct Message {
+        const Component *source = {};
+        state_t state = {};
+        Message *next = {};
+    };
+
+    struct Subscriber {
+        Component *component = {};
+        fn_t fn;
+    };
+
+    using key_t = std::pair<const Cluster *, std::string>;
+
+    void drain();
+
+    boost::asio::io_service& io_;
+    std::atomic<Message *> head_{nullptr}; // Newest first
+    std::map<key_t, std::vector<Subscriber>> subscribers_;
+};
+
+} // ns
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+namespace k8deployer {
+
+/*! Hierarchical timer wheel
+ *
+ * Serves all the timers for a cluster (probe polls, delays and
+ * deadlines) from one asio timer.
+ *
+ * There are 4 levels with 64 slots each. With the default 10 ms tick
+ * the levels cover 0.64 seconds, 41 seconds, 44 minutes and 46 hours.
+ * Timers are moved down a level when their slot comes up. Timers further
+ * away than the top level are re-inserted until they fit.
+ *
+ * The asio timer is only armed for the next slot that may have work,
+ * so an idle wheel don't wake up the io-thread.
+ *
+ * Only accessed from the clusters io-thread.
+ */
+class TimerWheel
+{
+public:
+    using id_t = uint64_t;
+    using fn_t = std::function<void ()>;
+    using clock_t = std::chrono::steady_clock;
+
+    TimerWheel(boost::asio::io_service& io,
+               std::chrono::milliseconds tick = std::chrono::milliseconds{10});
+
+    /*! Call fn after delay
+     *
+     * \return id that can be used to cancel the timer. Never 0.
+     */
+    id_t schedule(std::chrono::milliseconds delay, fn_t fn);
+
+    // Returns true if the timer was pending.
+    bool cancel(id_t id);
+
+    bool isPending(id_t id) const {
+        return id && timers_.find(id) != timers_.end();
+    }
+
+    size_t size() const noexcept {
+        return timers_.size();
+    }
+
+private:
+    static constexpr unsigned bits_ = 6;
+    static constexpr unsigned slots_ = 1u << bits_;
+    static constexpr unsigned levels_ = 4;
+    static constexpr uint64_t mask_ = slots_ - 1;
+
+    struct Timer {
+        uint64_t expires = 0; // tick
+        fn_t fn;
+    };
+
+    using slot_t = std::vector<id_t>;
+
+    uint64_t currentTick() const;
+    void place(id_t id, uint64_t expires);
+    void advance(uint64_t toTick);
+    void step();
+    void cascade(unsigned level);
+    void arm();
+    void onTimer(const boost::system::error_code& ec);
+
+    const std::chrono::milliseconds tick_;
+    const clock_t::time_point start_ = clock_t::now();
+    uint64_t now_ = 0; // Last processed tick
+    id_t nextId_ = 0;
+    std::unordered_map<id_t, Timer> timers_;
+    std::array<std::array<slot_t, slots_>, levels_> wheel_;
+    boost::asio::steady_timer timer_;
+    uint64_t armedFor_ = 0; // 0 when the asio timer is not armed
+};
+
+} // ns
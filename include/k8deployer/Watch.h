@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+#include "restc-cpp/RequestBuilder.h"
+#include "restc-cpp/SerializeJson.h"
+
+#include "k8deployer/Cluster.h"
+#include "k8deployer/Component.h"
+#include "k8deployer/Engine.h"
+#include "k8deployer/logging.h"
+
+namespace k8deployer {
+
+template <typename T>
+struct WatchEvent {
+    std::string type;
+    T object;
+};
+
+} // ns
+
+BOOST_FUSION_ADAPT_TPL_STRUCT(
+    (T),
+    (k8deployer::WatchEvent)(T),
+    (std::string, type)
+    (T, object)
+);
+
+namespace k8deployer {
+
+class WatchBase
+{
+public:
+    virtual ~WatchBase() = default;
+    virtual void start() = 0;
+};
+
+/*! A k8s watch stream that survives network problems
+ *
+ * - Resumes from the last seen resourceVersion when the stream is closed
+ *   or fails. Asks for bookmarks, so the resourceVersion stays fresh
+ *   even if nothing we watch is changing. A stream that is closed early,
+ *   without any events, is treated as a failure.
+ * - Reconnects with exponential back-off if the request fails, or if
+ *   the server sends an ERROR event.
+ * - Starts over without a resourceVersion (a re-list) on 410 Gone, either
+ *   as the reply or as the Status in an ERROR event. onReset is called
+ *   first, so any cache can be cleared.
+ * - The server is asked to close the stream after watchTimeoutSeconds,
+ *   and we give up on the connection if we receive nothing for a while
+ *   after that, so a silently dead connection is detected.
+ *
+ * The callbacks are called from the clusters io-thread.
+ */
+template <typename T>
+class Watch : public WatchBase
+{
+public:
+    using on_event_t = std::function<void (const WatchEvent<T>& event)>;
+    using on_reset_t = std::function<void ()>;
+    using is_active_t = std::function<bool ()>;
+    using args_t = std::map<std::string, std::string>;
+
+    Watch(Cluster& cluster, std::string url, args_t args, on_event_t onEvent,
+          on_reset_t onReset = {}, is_active_t isActive = {})
+        : cluster_{cluster}, url_{std::move(url)}, args_{std::move(args)}
+        , onEvent_{std::move(onEvent)}, onReset_{std::move(onReset)}
+        , isActive_{std::move(isActive)}
+    {
+        if (!isActive_) {
+            isActive_ = [&cluster] {
+                return cluster.state() <= Cluster::State::EXECUTING;
+            };
+        }
+    }
+
+    void start() override {
+        cluster_.client().Process([this](restc_cpp::Context& ctx) {
+            run(ctx);
+        });
+    }
+
+    const std::string& resourceVersion() const noexcept {
+        return resourceVersion_;
+    }
+
+    // Start from the resourceVersion of a LIST, instead of the current state
+    void setResourceVersion(std::string resourceVersion) {
+        resourceVersion_ = std::move(resourceVersion);
+    }
+
+private:
+    enum class Next {
+        READ, // Keep reading the stream
+        RESUME, // Reconnect now
+        BACKOFF, // Reconnect after the back-off
+        STOP
+    };
+
+    void run(restc_cpp::Context& ctx) {
+        const auto timeout = std::max(Engine::config().watchTimeoutSeconds, 1);
+        std::chrono::seconds backoff{1};
+
+        while(isActive_()) {
+            auto next = Next::BACKOFF;
+            try {
+                auto prop = std::make_shared<restc_cpp::Request::Properties>();
+                prop->recvTimeout = (timeout + 30) * 1000;
+
+                restc_cpp::RequestBuilder rb{ctx};
+                rb.Get(url_)
+                    .Properties(prop)
+                    .Header("X-Client", "k8deployer")
+                    .Argument("watch", "true")
+                    .Argument("allowWatchBookmarks", "true")
+                    .Argument("timeoutSeconds", std::to_string(timeout));
+
+                for(const auto& [name, value] : args_) {
+                    rb.Argument(name, value);
+                }
+
+                if (!resourceVersion_.empty()) {
+                    rb.Argument("resourceVersion", resourceVersion_);
+                }
+
+                LOG_DEBUG << cluster_.name() << " Starting watch on " << url_
+                          << " from resourceVersion '" << resourceVersion_ << "'";
+
+                auto reply = rb.Execute();
+                next = readEvents(*reply, backoff, std::chrono::seconds{timeout});
+            } catch(const restc_cpp::RequestFailedWithErrorException& err) {
+                if (err.http_response.status_code == 410) {
+                    reset();
+                    continue;
+                }
+
+                LOG_WARN << cluster_.name() << " Watch on " << url_ << " failed: "
+                         << err.http_response.status_code << ' ' << err.http_response.reason_phrase;
+            } catch(const std::exception& ex) {
+                LOG_WARN << cluster_.name() << " Watch on " << url_ << " failed: " << ex.what();
+            }
+
+            if (next == Next::STOP || !isActive_()) {
+                return;
+            }
+
+            if (next == Next::RESUME) {
+                continue;
+            }
+
+            LOG_DEBUG << cluster_.name() << " Reconnecting watch on " << url_
+                      << " in " << backoff.count() << " seconds";
+            ctx.Sleep(backoff);
+            backoff = std::min(backoff * 2, std::chrono::seconds{30});
+        }
+    }
+
+    // The stream has one json event per line
+    Next readEvents(restc_cpp::Reply& reply, std::chrono::seconds& backoff,
+                    std::chrono::seconds timeout) {
+        const auto started = std::chrono::steady_clock::now();
+        events_ = 0;
+        std::string buffer;
+        while(true) {
+            const auto data = reply.GetSomeData();
+            if (boost::asio::buffer_size(data) == 0) {
+                if (const auto next = onLine(buffer, backoff); next != Next::READ) {
+                    return next;
+                }
+
+                // The server closed the stream. Resume from where we are, unless
+                // it was closed right away, so we don't spin on a server or proxy
+                // that does that.
+                if (events_ == 0 && std::chrono::steady_clock::now() - started < timeout) {
+                    return Next::BACKOFF;
+                }
+                return Next::RESUME;
+            }
+
+            buffer.append(boost::asio::buffer_cast<const char *>(data), boost::asio::buffer_size(data));
+
+            size_t start = 0;
+            for(auto eol = buffer.find('\n'); eol != std::string::npos; eol = buffer.find('\n', start)) {
+                const auto next = onLine(std::string_view{buffer}.substr(start, eol - start), backoff);
+                start = eol + 1;
+                if (next != Next::READ) {
+                    return next;
+                }
+            }
+            buffer.erase(0, start);
+        }
+    }
+
+    Next onLine(std::string_view line, std::chrono::seconds& backoff) {
+        if (line.find_first_not_of(" \t\r") == std::string_view::npos) {
+            return Next::READ;
+        }
+
+        WatchEvent<T> event;
+        try {
+            parse(line, event);
+        } catch(const std::exception&) {
+            // The object in an ERROR event is a Status, that may not fit in T
+            WatchEvent<k8api::Status> error;
+            parse(line, error);
+            if (error.type != "ERROR") {
+                throw;
+            }
+            return onError(error.object);
+        }
+
+        if (event.type == "ERROR") {
+            WatchEvent<k8api::Status> error;
+            parse(line, error);
+            return onError(error.object);
+        }
+
+        backoff = std::chrono::seconds{1};
+        ++events_;
+
+        if (auto meta = getObjectMeta(event.object); meta && !meta->resourceVersion.empty()) {
+            resourceVersion_ = meta->resourceVersion;
+        }
+
+        if (event.type != "BOOKMARK") {
+            onEvent_(event);
+        }
+
+        return isActive_() ? Next::READ : Next::STOP;
+    }
+
+    Next onError(const k8api::Status& status) {
+        if (status.code == 410) {
+            // Our resourceVersion is too old
+            reset();
+            return Next::RESUME;
+        }
+
+        LOG_WARN << cluster_.name() << " Watch on " << url_ << " failed: "
+                 << status.code << ' ' << status.reason << ": " << status.message;
+        return Next::BACKOFF;
+    }
+
+    template <typename E>
+    static void parse(std::string_view line, E& event) {
+        restc_cpp::serialize_properties_t sp;
+        sp.name_mapping = jsonFieldMappings();
+        std::istringstream in{std::string{line}};
+        restc_cpp::SerializeFromJson(event, in, sp);
+    }
+
+    void reset() {
+        LOG_DEBUG << cluster_.name() << " Watch on " << url_ << " expired. Starting over.";
+        resourceVersion_.clear();
+        if (onReset_) {
+            onReset_();
+        }
+    }
+
+    Cluster& cluster_;
+    const std::string url_;
+    const args_t args_;
+    on_event_t onEvent_;
+    on_reset_t onReset_;
+    is_active_t isActive_;
+    std::string resourceVersion_;
+    size_t events_ = 0; // Events and bookmarks on the current connection
+};
+
+} // ns
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <typeindex>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+#include <boost/fusion/include/adapt_struct.hpp>
+#include <boost/fusion/include/for_each.hpp>
+#include <boost/fusion/include/is_sequence.hpp>
+#include <boost/fusion/include/size.hpp>
+#include <boost/fusion/include/value_at.hpp>
+
+namespace k8deployer {
+
+/*! Compact binary serialization of the structs we adapt for json
+ *
+ * Handles arithmetic types, strings, optionals, maps, sequence containers
+ * and boost fusion adapted structs. The members are written in the order
+ * they are adapted, without names. Lengths and counts are 32 bit.
+ * Numbers are in the native byte order, so the data is only meant to be
+ * read back by the same build, on the same machine.
+ */
+
+namespace binary_traits {
+
+template <typename T>
+struct is_optional : std::false_type {};
+
+template <typename T>
+struct is_optional<std::optional<T>> : std::true_type {};
+
+template <typename T, typename = void>
+struct is_map : std::false_type {};
+
+template <typename T>
+struct is_map<T, std::void_t<typename T::key_type, typename T::mapped_type>> : std::true_type {};
+
+template <typename T, typename = void>
+struct is_container : std::false_type {};
+
+template <typename T>
+struct is_container<T, std::void_t<typename T::value_type,
+    decltype(std::declval<T&>().push_back(std::declval<typename T::value_type>()))>> : std::true_type {};
+
+inline void writeSize(size_t size, std::string& out) {
+    if (size > UINT32_MAX) {
+        throw std::runtime_error("Too large for the binary format");
+    }
+    const auto len = static_cast<uint32_t>(size);
+    out.append(reinterpret_cast<const char *>(&len), sizeof(len));
+}
+
+inline void read(void *dst, size_t len, std::string_view& in) {
+    if (in.size() < len) {
+        throw std::runtime_error("Truncated binary data");
+    }
+    memcpy(dst, in.data(), len);
+    in.remove_prefix(len);
+}
+
+inline size_t readSize(std::string_view& in) {
+    uint32_t len = 0;
+    read(&len, sizeof(len), in);
+    return len;
+}
+
+template <typename T>
+void describe(std::string& out, std::vector<std::type_index>& parents);
+
+template <typename T, size_t... I>
+void describeMembers(std::string& out, std::vector<std::type_index>& parents,
+                     std::index_sequence<I...>) {
+    ((out += boost::fusion::extension::struct_member_name<T, I>::call(),
+      out += ':',
+      describe<typename boost::fusion::result_of::value_at_c<T, I>::type>(out, parents),
+      out += ';'), ...);
+}
+
+template <typename T>
+void describe(std::string& out, std::vector<std::type_index>& parents) {
+    if constexpr (std::is_arithmetic_v<T>) {
+        out += typeid(T).name();
+        out += std::to_string(sizeof(T));
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        out += 's';
+    } else if constexpr (is_optional<T>::value) {
+        out += "o<";
+        describe<typename T::value_type>(out, parents);
+        out += '>';
+    } else if constexpr (is_map<T>::value) {
+        out += "m<";
+        describe<typename T::key_type>(out, parents);
+        out += ',';
+        describe<typename T::mapped_type>(out, parents);
+        out += '>';
+    } else if constexpr (is_container<T>::value) {
+        out += "v<";
+        describe<typename T::value_type>(out, parents);
+        out += '>';
+    } else {
+        static_assert(boost::fusion::traits::is_sequence<T>::value,
+                      "Not supported by the binary format");
+        const std::type_index type{typeid(T)};
+        out += type.name();
+        // Recursive types, like a component with children
+        if (std::find(parents.begin(), parents.end(), type) != parents.end()) {
+            return;
+        }
+        parents.push_back(type);
+        out += '{';
+        describeMembers<T>(out, parents,
+                           std::make_index_sequence<boost::fusion::result_of::size<T>::value>{});
+        out += '}';
+        parents.pop_back();
+    }
+}
+
+} // binary_traits
+
+/*! The layout of T in the binary format
+ *
+ * Lists the names and types of the members of the adapted structs, so it
+ * changes when a struct is changed.
+ */
+template <typename T>
+const std::string& binaryLayout()
+{
+    static const std::string layout = [] {
+        std::string out;
+        std::vector<std::type_index> parents;
+        binary_traits::describe<T>(out, parents);
+        return out;
+    }();
+    return layout;
+}
+
+template <typename T>
+void toBinary(const T& obj, std::string& out)
+{
+    using namespace binary_traits;
+
+    if constexpr (std::is_arithmetic_v<T>) {
+        out.append(reinterpret_cast<const char *>(&obj), sizeof(obj));
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        writeSize(obj.size(), out);
+        out += obj;
+    } else if constexpr (is_optional<T>::value) {
+        toBinary(obj.has_value(), out);
+        if (obj) {
+            toBinary(*obj, out);
+        }
+    } else if constexpr (is_map<T>::value || is_container<T>::value) {
+        writeSize(obj.size(), out);
+        for(const auto& item : obj) {
+            if constexpr (is_map<T>::value) {
+                toBinary(item.first, out);
+                toBinary(item.second, out);
+            } else {
+                toBinary(item, out);
+            }
+        }
+    } else {
+        static_assert(boost::fusion::traits::is_sequence<T>::value,
+                      "Not supported by the binary format");
+        boost::fusion::for_each(obj, [&out](const auto& member) {
+            toBinary(member, out);
+        });
+    }
+}
+
+/*! Deserialize obj from the start of in
+ *
+ * The data that is used is removed from in.
+ * \throws runtime_error if the data is truncated
+ */
+template <typename T>
+void fromBinary(T& obj, std::string_view& in)
+{
+    using namespace binary_traits;
+
+    if constexpr (std::is_arithmetic_v<T>) {
+        read(&obj, sizeof(obj), in);
+    } else if constexpr (std::is_same_v<T, std::string>) {
+        const auto len = readSize(in);
+        if (in.size() < len) {
+            throw std::runtime_error("Truncated binary data");
+        }
+        obj.assign(in.data(), len);
+        in.remove_prefix(len);
+    } else if constexpr (is_optional<T>::value) {
+        bool hasValue = false;
+        fromBinary(hasValue, in);
+        obj.reset();
+        if (hasValue) {
+            fromBinary(obj.emplace(), in);
+        }
+    } else if constexpr (is_map<T>::value) {
+        obj.clear();
+        for(auto count = readSize(in); count > 0; --count) {
+            typename T::key_type key;
+            typename T::mapped_type value;
+            fromBinary(key, in);
+            fromBinary(value, in);
+            obj.emplace(std::move(key), std::move(value));
+        }
+    } else if constexpr (is_container<T>::value) {
+        obj.clear();
+        for(auto count = readSize(in); count > 0; --count) {
+            fromBinary(obj.emplace_back(), in);
+        }
+    } else {
+        static_assert(boost::fusion::traits::is_sequence<T>::value,
+                      "Not supported by the binary format");
+        boost::fusion::for_each(obj, [&in](auto& member) {
+            fromBinary(member, in);
+        });
+    }
+}
+
+} // ns
@@ -1,10 +1,22 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace k8deployer {
 
-double exprtkDouble(const std::string& arg);
+/*! Evaluate an expression
+ *
+ * The compiled expressions are cached on their text, so a repeated
+ * expression is only parsed once.
+ *
+ * \param arg The expression.
+ * \param args Values for the variables `k8v0`, `k8v1`... in the expression.
+ *      For the same expression text, the number of args must be the same.
+ */
+double exprtkDouble(const std::string& arg, const std::vector<double>& args = {});
 
-}
+// Name of the variable in an expression for the arg at index ix
+std::string exprtkArgName(size_t ix);
 
+}
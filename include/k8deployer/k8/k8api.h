@@ -62,6 +62,7 @@ struct ObjectMeta {
     std::string generateName;
     int generation = 0;
     std::vector<OwnerReference> ownerReferences;
+    std::string resourceVersion;
     std::string selfLink;
     std::string uid;
 };
@@ -106,6 +107,16 @@ struct Event {
 
 using events_t = std::vector<Event>;
 
+// The object in a watch ERROR event, and in failed replies
+struct Status {
+    std::string apiVersion;
+    std::string kind;
+    std::string status;
+    std::string message;
+    std::string reason;
+    int code = 0;
+};
+
 struct ListMeta {
     std::string continue_;
     int remainingItemCount = 0;
@@ -1130,6 +1141,7 @@ BOOST_FUSION_ADAPT_STRUCT(k8deployer::k8api::ObjectMeta,
     (std::string, generateName)
     (int, generation)
     (std::vector<k8deployer::k8api::OwnerReference>, ownerReferences)
+    (std::string, resourceVersion)
     (std::string, selfLink)
     (std::string, uid)
 );
@@ -1162,6 +1174,14 @@ BOOST_FUSION_ADAPT_STRUCT(k8deployer::k8api::Event,
     (k8deployer::k8api::ObjectReference, related)
 );
 
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::k8api::Status,
+    (std::string, apiVersion)
+    (std::string, kind)
+    (std::string, status)
+    (std::string, message)
+    (std::string, reason)
+    (int, code)
+);
 
 BOOST_FUSION_ADAPT_STRUCT(k8deployer::k8api::ListMeta,
 (std::string, continue_) // NB
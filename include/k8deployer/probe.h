@@ -5,6 +5,7 @@
 #include "k8deployer/Engine.h"
 #include "k8deployer/Cluster.h"
 #include "k8deployer/Component.h"
+#include "k8deployer/ObjectWatch.h"
 #include "k8deployer/logging.h"
 
 namespace k8deployer {
@@ -14,29 +15,73 @@ void sendProbe(Component& component, const std::string& url,
                std::function<void(const std::optional<T>& object, Component::K8ObjectState state)> onDone,
                TvalidateFn && validate)
 {
-        component.client().Process([url, &component,
-                             onDone=std::move(onDone),
-                             validate=std::move(validate)](auto& ctx) {
+    if constexpr (IsWatched<T>::value) {
+        if (Engine::config().watchObjects) {
+            // Use the watch's copy of the object if we have it
+            if (const auto pos = url.rfind('/'); pos != std::string::npos) {
+                const auto name = url.substr(pos + 1);
+                auto& watch = getObjectWatch<T>(component.cluster(), url.substr(0, pos),
+                                                "k8dep-deployment=" + component.getRoot().name);
+                watch.addInterest(name, component.weak_from_this());
+
+                if (auto object = watch.get(name)) {
+                    const auto done = validate(*object);
+                    LOG_TRACE << component.logName() << "Probing from watch: done = " << (done ? "yes": "no");
+                    onDone(*object, done ? Component::K8ObjectState::DONE : Component::K8ObjectState::INIT);
+                    return;
+                }
+            }
+        }
+    }
+
+    component.cluster().governor().process([url, &component,
+                                           onDone=std::move(onDone),
+                                           validate=std::move(validate)](auto& ctx) {
 
         LOG_TRACE << component.logName() << "Probing";
 
         try {
-            T data;
-            auto reply = restc_cpp::RequestBuilder{ctx}.Get(url)
-                    .Execute();
-
-            restc_cpp::SerializeFromJson(data, *reply);
-            const auto done = validate(data);
+            auto reply = component.cluster().governor().execute(
+                        restc_cpp::RequestBuilder{ctx}.Get(url));
 
             LOG_TRACE << component.logName()
                   << "Probing gave response: "
                   << reply->GetResponseCode() << ' '
-                  << reply->GetHttpResponse().reason_phrase
-                  << ", done = " << (done ? "yes": "no");
+                  << reply->GetHttpResponse().reason_phrase;
+
+            // Parse the reply on the clusters worker-pool, if enabled. The validation
+            // may look at the component, so it's done back on the io-thread.
+            auto data = std::make_shared<T>();
+            auto body = std::make_shared<std::string>(reply->GetBodyAsString());
+            component.cluster().offload([data, body] {
+                std::istringstream in{*body};
+                restc_cpp::SerializeFromJson(*data, in);
+            }, [wcomponent=component.weak_from_this(), data, onDone, validate](std::exception_ptr eptr) {
+                auto c = wcomponent.lock();
+                if (!c) {
+                    return;
+                }
 
-            onDone(data, done ? Component::K8ObjectState::DONE : Component::K8ObjectState::INIT);
+                if (eptr) {
+                    try {
+                        std::rethrow_exception(eptr);
+                    } catch(const std::exception& ex) {
+                        LOG_WARN << c->logName()
+                                 << "Probing failed to parse the reply: " << ex.what();
+                    }
+                    onDone({}, Component::K8ObjectState::FAILED);
+                    return;
+                }
+
+                const auto done = validate(*data);
+                LOG_TRACE << c->logName() << "Probing done = " << (done ? "yes": "no");
+                onDone(*data, done ? Component::K8ObjectState::DONE : Component::K8ObjectState::INIT);
+            });
             return;
         } catch(const restc_cpp::RequestFailedWithErrorException& err) {
+            if (RequestGovernor::isThrottled(err)) {
+                throw; // Let the governor retry
+            }
 
             if (err.http_response.status_code == 404) {
                 LOG_TRACE << component.logName()
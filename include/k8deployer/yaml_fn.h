@@ -0,0 +1,38 @@
+#pragma once
+
+#include <functional>
+#include <string>
+
+namespace k8deployer {
+
+/*! Called for each scalar when yaml is converted to json
+ *
+ * \param out The json so far
+ * \param value The scalar
+ * \param plain true if the scalar was not quoted or tagged as a string
+ * \param isKey true if the scalar is a key in a map
+ *
+ * \return true if the hook has added the scalar to out
+ */
+using yaml_scalar_hook_t = std::function<bool (std::string& out, const std::string& value,
+                                               bool plain, bool isKey)>;
+
+/*! Convert yaml to json
+ *
+ * Plain scalars are typed like the yaml 1.1 rules used by python's
+ * yaml.safe_load(), so `yes`, `0x10` and `~` becomes true, 16 and null.
+ * Only the first document is converted.
+ *
+ * \param yaml The yaml text
+ * \param name Name of the source, used in error messages
+ * \param hook Optional hook for the scalars
+ *
+ * \throws runtime_error if the yaml is invalid
+ */
+std::string yamlToJson(const std::string& yaml, const std::string& name,
+                       const yaml_scalar_hook_t& hook = {});
+
+// Append the json for a scalar. Keys are always strings.
+void appendYamlScalar(std::string& out, const std::string& value, bool plain, bool isKey = false);
+
+}
@@ -2,6 +2,7 @@
 #include "k8deployer/BaseComponent.h"
 #include "k8deployer/DeploymentComponent.h"
 #include "k8deployer/Cluster.h"
+#include "k8deployer/EventIndex.h"
 
 using namespace std;
 using namespace string_literals;
@@ -181,6 +182,13 @@ void BaseComponent::addDeploymentTasks(Component::tasks_t& tasks)
                       << " evaluating event: " << event->message;
 
             auto key = name + "-";
+            if (event->involvedObject.namespace_ == getNamespace()
+                && (event->involvedObject.name == name
+                    || event->involvedObject.name.substr(0, key.size()) == key)) {
+                // Something happened to our object or one of it's pods.
+                task.pollNow();
+            }
+
             if (event->involvedObject.kind == "Pod"
                 && event->involvedObject.name.substr(0, key.size()) == key
                 && event->metadata.namespace_ == deployment.metadata.namespace_
@@ -203,6 +211,12 @@ void BaseComponent::addDeploymentTasks(Component::tasks_t& tasks)
     });
 
     task->startProbeAfterApply = probe(nullptr);
+
+    // Events for our object, and for it's pods
+    auto& events = getEventIndex();
+    events.add(toString(kind_), getNamespace(), name, task);
+    events.addPrefix("Pod", getNamespace(), name + "-", task);
+
     tasks.push_back(task);
     Component::addDeploymentTasks(tasks);
 }
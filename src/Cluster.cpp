@@ -19,78 +19,12 @@
 #include "k8deployer/Cluster.h"
 #include "k8deployer/Engine.h"
 #include "k8deployer/Component.h"
+#include "k8deployer/EventIndex.h"
+#include "k8deployer/ObjectWatch.h"
+#include "k8deployer/Simulator.h"
+#include "k8deployer/Watch.h"
 #include "k8deployer/k8/k8api.h"
 
-namespace k8deployer {
-struct EventStream {
-    std::string type;
-    k8api::Event object;
-};
-
-struct PodStream {
-    std::string type;
-    k8api::Pod object;
-};
-
-} // ns
-
-BOOST_FUSION_ADAPT_STRUCT(k8deployer::PodStream,
-    (std::string, type)
-    (k8deployer::k8api::Pod, object)
-    );
-
-BOOST_FUSION_ADAPT_STRUCT(k8deployer::StorageDef,
-    (k8deployer::k8api::VolumeMount, volume)
-    (std::string, capacity)
-    (bool, createVolume)
-    (std::string, chownUser)
-    (std::string, chownGroup)
-    (std::string, chmodMode)
-    );
-
-BOOST_FUSION_ADAPT_STRUCT(k8deployer::ComponentDataDef,
-    // ComponentData
-    (std::string, name)
-    (std::string, variant)
-    (bool, enabled)
-    (k8deployer::labels_t, labels)
-    (k8deployer::conf_t, defaultArgs)
-    (k8deployer::conf_t, args)
-    (k8deployer::k8api::string_list_t, depends)
-    (k8deployer::k8api::Job, job)
-    (k8deployer::k8api::Deployment, deployment)
-    (k8deployer::k8api::StatefulSet, statefulSet)
-    (k8deployer::k8api::DaemonSet, daemonset)
-    (k8deployer::k8api::Service, service)
-    (std::optional<k8deployer::k8api::Secret>, secret)
-    (k8deployer::k8api::PersistentVolume, persistentVolume)
-    (k8deployer::k8api::Ingress, ingress)   
-    (k8deployer::k8api::Namespace, namespace_)
-    (k8deployer::k8api::Role, role)
-    (k8deployer::k8api::ClusterRole, clusterrole)
-    (k8deployer::k8api::RoleBinding, rolebinding)
-    (k8deployer::k8api::ClusterRoleBinding, clusterrolebinding)
-    (k8deployer::k8api::ServiceAccount, serviceaccount)
-    (std::optional<k8deployer::k8api::SecurityContext>, podSecurityContext)
-    (std::optional<k8deployer::k8api::PodSecurityContext>, podSpecSecurityContext)
-    (std::optional<k8deployer::k8api::Probe>, startupProbe)
-    (std::optional<k8deployer::k8api::Probe>, livenessProbe)
-    (std::optional<k8deployer::k8api::Probe>, readinessProbe)
-    (std::vector<k8deployer::StorageDef>, storage)
-
-    // ComponentDataDef
-    (std::string, kind)
-    (std::string, parentRelation)
-    (k8deployer::ComponentDataDef::childrens_t, children)
-    );
-
-BOOST_FUSION_ADAPT_STRUCT(k8deployer::EventStream,
-                          (std::string, type)
-                          (k8deployer::k8api::Event, object)
-                          );
-
-
-
 using namespace std;
 using namespace string_literals;
 using namespace restc_cpp;
@@ -127,12 +61,53 @@ Cluster::Cluster(const Config &cfg, const string &arg, const size_t id)
         storage_ = Storage::create(cfg_.storageEngine);
     }
 
-    vars_ready_pr_.set_value();
+    if (cfg_.workerThreads) {
+        workerIo_ = make_unique<boost::asio::io_service>();
+        workerWork_ = make_unique<boost::asio::io_service::work>(*workerIo_);
+        for(size_t i = 0; i < cfg_.workerThreads; ++i) {
+            workers_.emplace_back([this] {
+                workerIo_->run();
+            });
+        }
+    }
 }
 
 Cluster::~Cluster()
 {
+    if (workerIo_) {
+        workerWork_.reset();
+        workerIo_->stop();
+        for(auto& worker : workers_) {
+            worker.join();
+        }
+    }
+}
 
+void Cluster::offload(Cluster::work_fn_t work, Cluster::continuation_fn_t then)
+{
+    if (!workerIo_) {
+        exception_ptr eptr;
+        try {
+            work();
+        } catch(...) {
+            eptr = current_exception();
+        }
+        then(eptr);
+        return;
+    }
+
+    workerIo_->post([this, work=move(work), then=move(then)] {
+        exception_ptr eptr;
+        try {
+            work();
+        } catch(...) {
+            eptr = current_exception();
+        }
+
+        client_->GetIoService().post([then=move(then), eptr] {
+            then(eptr);
+        });
+    });
 }
 
 //void Cluster::startProxy()
@@ -171,6 +146,18 @@ string Cluster::getUrl() const
     return url_;
 }
 
+void Cluster::init()
+{
+    if (Engine::mode() == Engine::Mode::SIMULATE) {
+        // Nothing is sent to the cluster
+        createClient({});
+    } else {
+        loadKubeconfig();
+    }
+
+    initVariables();
+}
+
 std::future<void> Cluster::prepare()
 {
     // Prepare the clusters in paralell.
@@ -180,13 +167,11 @@ std::future<void> Cluster::prepare()
     setState(State::INIT);
     LOG_INFO << name () << " Preparing ...";
 
-    loadKubeconfig();
-
     auto pr = make_shared<promise<void>>();
 
     assert(client_);
 
-    if (!cfg_.dnsServerConfig.empty()) {
+    if (!cfg_.dnsServerConfig.empty() && Engine::mode() != Engine::Mode::SIMULATE) {
         dns_ = DnsProvisioner::create(Engine::config().dnsServerConfig,
                                       client_->GetIoService());
         if (!dns_) {
@@ -203,6 +188,7 @@ std::future<void> Cluster::prepare()
           if (rootComponent_) {
               assert(prepareCmd_);
               prepareCmd_();
+              namespaces_ = rootComponent_->getNamespaces();
               prepared_ready_pr_.set_value();
           } else {
               LOG_WARN << name() << " No components. Nothing to do.";
@@ -219,9 +205,15 @@ std::future<void> Cluster::prepare()
 
 std::future<void> Cluster::execute()
 {
-    if (Engine::mode() == Engine::Mode::DEPLOY && !Engine::config().logDir.empty()) {
+    if (Engine::isApplying() && !Engine::config().logDir.empty()) {
         listenForContainers();
     }
+    if (Engine::isApplying() && rootComponent_
+            && !rootComponent_->getEventIndex().empty()) {
+        for(const auto& ns : namespaces_) {
+            startEventsLoop(ns);
+        }
+    }
     if (executeCmd_) {
         setState(State::EXECUTING);
         LOG_INFO << name () << " " << verb_ << " ...";
@@ -246,18 +238,6 @@ std::future<void> Cluster::pendingWork()
     return pendingWork_.get_future();
 }
 
-bool Cluster::addStateListener(const std::string& componentName,
-                               const std::function<void (const Component& component)>& fn)
-{
-    // Called from any thread.
-    if (auto c = getComponent(componentName)) {
-        c->addStateListener(fn);
-        return true;
-    }
-
-    return false;
-}
-
 void Cluster::add(Component *component)
 {
     std::lock_guard<std::mutex> lock{mutex_};
@@ -278,70 +258,45 @@ Component *Cluster::getComponent(const string &name)
 void Cluster::listenForContainers()
 {
     assert(client_);
-    client_->Process([this](restc_cpp::Context& ctx) {
-        const auto url = url_ + "/api/v1/namespaces/"
-            + *getVar("namespace")
-            + "/pods";
+    const auto url = url_ + "/api/v1/namespaces/"
+        + *getVar("namespace")
+        + "/pods";
 
-        auto prop = make_shared<Request::Properties>();
-        prop->recvTimeout = (60 * 60 * 24) * 1000;
-
-        auto reply = RequestBuilder(ctx)
-                .Get(url)
-                .Properties(prop)
-                .Argument("watch", "true")
-                .Argument("labelSelector", "k8dep-deployment="s
-                          + rootComponent_->name)
-                .Header("X-Client", "k8deployer")
-                .Execute();
-
-        serialize_properties_t sp;
-        sp.name_mapping = jsonFieldMappings();
-
-        try {
-            IteratorFromJsonSerializer<PodStream> pods{*reply, &sp, true};
-            for(const auto& pod : pods) {
-                LOG_TRACE << name_ << " Container: " << pod.type << " " << pod.object.metadata.name;
-
-                // See if we should start logging for the container
-                for(const auto& c: pod.object.status.containerStatuses) {
-                    auto& prevState = knownContainers_[c.containerID];
-                    if (prevState.name.empty()) {
-                        // New container. Delete any existing log file?
-                        prepareLogging(pod.object, c);
-                    }
-
-                    if (c.started != prevState.started) {
-                        if (c.started) {
-                            startLogging(pod.object, c);
-                        } else {
-                            stopLogging(pod.object, c);
-                        }
-                    }
+    auto& watch = watches_[url];
+    if (watch) {
+        return;
+    }
 
-                    prevState = c;
+    watch = make_unique<Watch<k8api::Pod>>(*this, url,
+        Watch<k8api::Pod>::args_t{{"labelSelector", "k8dep-deployment="s + rootComponent_->name}},
+        [this](const WatchEvent<k8api::Pod>& pod) {
+            LOG_TRACE << name_ << " Container: " << pod.type << " " << pod.object.metadata.name;
+
+            // See if we should start logging for the container
+            for(const auto& c: pod.object.status.containerStatuses) {
+                auto& prevState = knownContainers_[c.containerID];
+                if (prevState.name.empty()) {
+                    // New container. Delete any existing log file?
+                    prepareLogging(pod.object, c);
                 }
 
-                if (state() > State::EXECUTING) {
-                    LOG_DEBUG << name_ << " State is > EXECUTING. Exciting container watch loop.";
-                    break;
+                if (c.started != prevState.started) {
+                    if (c.started) {
+                        startLogging(pod.object, c);
+                    } else {
+                        stopLogging(pod.object, c);
+                    }
                 }
-            }
-        } catch (const exception& ex) {
-            LOG_ERROR << "Caught exception from event-loop: " << ex.what();
 
-            // If we get an exception before we are shutting down, it's an error
-            // TODO: Try to recover if we are in PROCESSING state
-            if (state() < State::ERROR) {
-                setState(State::ERROR);
+                prevState = c;
             }
-        }
-    });
+        });
+    watch->start();
 }
 
 void Cluster::loadKubeconfig()
 {
-    auto kc = Kubeconfig::load(kubeconfig_);
+    auto kc = Kubeconfig::load(kubeconfig_, Engine::instance().cache());
 
     // Prepare tls for rest client
     auto tls = make_shared<boost::asio::ssl::context>(
@@ -360,71 +315,184 @@ void Cluster::loadKubeconfig()
     const auto key = kc->getClientKey();
     tls->use_private_key({key.data(), key.size()}, boost::asio::ssl::context_base::pem);
 
-    restc_cpp::Request::Properties properties;
-    properties.cacheMaxConnectionsPerEndpoint = 64;
-    client_ = restc_cpp::RestClient::Create(tls, properties);
+    createClient(tls);
 
     url_ = kc->getServer();
 
     LOG_INFO << name() << " Will connect directly to: " << url_;
 }
 
-void Cluster::startEventsLoop()
+void Cluster::createClient(const std::shared_ptr<boost::asio::ssl::context>& tls)
 {
-    LOG_DEBUG << "Starting event-loops";
-    client_->Process([this](Context& ctx) {
-        const auto url = url_ + "/api/v1/events";
+    restc_cpp::Request::Properties properties;
+    // Leave some connections for the event-loops
+    properties.cacheMaxConnectionsPerEndpoint = max<size_t>(64, cfg_.maxRequestsInFlight + 8);
+    client_ = tls ? restc_cpp::RestClient::Create(tls, properties)
+                  : restc_cpp::RestClient::Create(properties);
+    governor_ = make_unique<RequestGovernor>(*client_, name(), cfg_.maxRequestsInFlight,
+                                             chrono::milliseconds{cfg_.requestLatencyThresholdMs},
+                                             properties);
+    timers_ = make_unique<TimerWheel>(client_->GetIoService());
+    stateBus_ = make_unique<StateBus>(client_->GetIoService());
+}
 
-        auto prop = make_shared<Request::Properties>();
-        prop->recvTimeout = (60 * 60 * 24) * 1000;
+std::future<void> Cluster::simulate()
+{
+    auto pr = make_shared<promise<void>>();
 
-        auto reply = RequestBuilder(ctx)
-                .Get(url)
-                .Properties(prop)
-                .Header("X-Client", "k8deployer")
-                .Argument("watch","true")
-                .Execute();
+    client_->GetIoService().post([this, pr] {
+        try {
+            auto model = cfg_.simModel.empty() ? Simulator::model_t{} : Simulator::loadModel(cfg_.simModel);
+            Simulator{*rootComponent_, move(model), cfg_.simSeed}.run(cfg_.simRuns);
+            setState(State::DONE);
+            pr->set_value();
+        } catch(const exception& ex) {
+            LOG_ERROR << name() << " Simulation failed: " << ex.what();
+            setState(State::ERROR);
+            pr->set_exception(current_exception());
+        }
+    });
 
-        // 'namespace' is a reserved word in C++, so we have to map it
-        serialize_properties_t sp;
-        sp.name_mapping = jsonFieldMappings();
+    return pr->get_future();
+}
 
-        IteratorFromJsonSerializer<EventStream> events{*reply, &sp, true};
+void Cluster::startEventsLoop(const string& ns)
+{
+    const auto url = url_ + "/api/v1/namespaces/" + ns + "/events";
 
-        try {
-            for(const auto& item : events) {
-                // This gets called asynchrounesly for each event we get from the server
-                const auto& event = item.object;
-                LOG_TRACE << name() << ": got event: "
-                          << event.metadata.namespace_ << '.'
-                          << event.metadata.name
-                          << " [" << event.reason
-                          << "] " << event.message;
-
-                if (rootComponent_) {
-                    auto ep = make_shared<k8api::Event>(event);
-                    rootComponent_->onEvent(ep);
+    auto& watch = watches_[url];
+    if (watch) {
+        return;
+    }
+
+    LOG_DEBUG << name() << " Starting event-loop for namespace " << ns;
+
+    Watch<k8api::Event>::args_t args;
+    if (!cfg_.eventsFieldSelector.empty()) {
+        args["fieldSelector"] = cfg_.eventsFieldSelector;
+    }
+
+    watch = make_unique<Watch<k8api::Event>>(*this, url, move(args),
+        [this](const WatchEvent<k8api::Event>& item) {
+            // This gets called asynchrounesly for each event we get from the server
+            const auto& event = item.object;
+            LOG_TRACE << name() << ": got event: "
+                      << event.metadata.namespace_ << '.'
+                      << event.metadata.name
+                      << " [" << event.reason
+                      << "] " << event.message;
+
+            if (rootComponent_) {
+                // Drop events that no task has asked for before we copy them
+                auto tasks = rootComponent_->getEventIndex().lookup(event);
+                if (tasks.empty()) {
+                    return;
                 }
-            }
-        } catch (const exception& ex) {
-            LOG_ERROR << "Caught exception from event-loop: " << ex.what();
 
-            // If we get an exception before we are shutting down, it's an error
-            // TODO: Try to recover if we are in PROCESSING state
-            if (state() < State::ERROR) {
-                setState(State::ERROR);
+                auto ep = make_shared<k8api::Event>(event);
+                rootComponent_->onEvent(ep, move(tasks));
             }
-        }
+        });
+    watch->start();
+}
+
+namespace {
+
+struct ListedObject {
+    k8api::ObjectMeta metadata;
+};
+
+struct ObjectList {
+    std::vector<ListedObject> items;
+};
+
+} // anon ns
+} // ns
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::ListedObject,
+    (k8deployer::k8api::ObjectMeta, metadata)
+    );
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::ObjectList,
+    (std::vector<k8deployer::ListedObject>, items)
+    );
+
+namespace k8deployer {
+
+std::future<void> Cluster::deploy()
+{
+    if (!cfg_.skipUnchanged) {
+        return rootComponent_->deploy();
+    }
+
+    // The tasks need the fingerprints, so they start when the LISTs are done
+    auto pr = make_shared<promise<void>>();
+    client_->GetIoService().post([this, pr] {
+        fetchLiveHashes(rootComponent_->getCollectionUrls(), [this, pr] {
+            rootComponent_->deploy(pr);
+        });
     });
+
+    return pr->get_future();
 }
 
-void Cluster::readDefinitions()
+void Cluster::fetchLiveHashes(const std::set<string>& urls, std::function<void ()> then)
 {
-    LOG_DEBUG << name_ << ": Creating components from " << cfg_.definitionFile;
+    if (urls.empty()) {
+        then();
+        return;
+    }
 
-    // Load component definitions
-    dataDef_ = make_unique<ComponentDataDef>();
+    auto pending = make_shared<size_t>(urls.size());
+    auto done = [this, pending, then=move(then)] {
+        if (--*pending == 0) {
+            LOG_DEBUG << name() << " Found " << liveHashes_.size() << " deployed objects with fingerprints.";
+            then();
+        }
+    };
+
+    // One LIST for each collection we deploy to, for the objects from this deployment.
+    // We only need the annotations, so just the metadata is fetched.
+    for(const auto& url : urls) {
+        governor().process([this, url, done](Context& ctx) {
+            try {
+                auto reply = governor().execute(RequestBuilder{ctx}.Get(url)
+                        .Header("X-Client", "k8deployer")
+                        .Header("Accept", "application/json;as=PartialObjectMetadataList;g=meta.k8s.io;v=v1")
+                        .Argument("labelSelector", "k8dep-deployment="s + rootComponent_->name));
+
+                serialize_properties_t sp;
+                sp.name_mapping = jsonFieldMappings();
+
+                ObjectList list;
+                SerializeFromJson(list, move(reply), sp);
+
+                for(const auto& item : list.items) {
+                    const auto& annotations = item.metadata.annotations;
+                    if (auto it = annotations.find(fingerprintAnnotation); it != annotations.end()) {
+                        liveHashes_[url + "/" + item.metadata.name] = it->second;
+                    }
+                }
+            } catch(const RequestFailedWithErrorException& err) {
+                if (RequestGovernor::isThrottled(err)) {
+                    throw; // Let the governor retry
+                }
 
+                LOG_DEBUG << name() << " Failed to list " << url << ": "
+                          << err.http_response.status_code << ' ' << err.http_response.reason_phrase
+                          << ". The objects will be deployed.";
+            } catch(const exception& ex) {
+                LOG_DEBUG << name() << " Failed to list " << url << ": " << ex.what()
+                          << ". The objects will be deployed.";
+            }
+
+            client_->GetIoService().post(done);
+        });
+    }
+}
+
+void Cluster::initVariables()
+{
     {
         auto vars = cfg_.variables;
 
@@ -453,8 +521,14 @@ void Cluster::readDefinitions()
     for(const auto& [k, v]: variables_) {
         LOG_DEBUG << "Cluster " << name_ << " has variable: " << k << '=' << v;
     }
+}
 
-    fileToObject(*dataDef_, cfg_.definitionFile, variables_, true);
+void Cluster::readDefinitions()
+{
+    LOG_DEBUG << name_ << ": Creating components from " << cfg_.definitionFile;
+
+    // Load component definitions
+    dataDef_ = Engine::instance().definition().instantiate(variables_);
     if (dataDef_->kind.empty()) {
         LOG_ERROR << "Invalid definition file: " << cfg_.definitionFile;
         throw runtime_error("Invalid definition "s + cfg_.definitionFile);
@@ -466,7 +540,31 @@ void Cluster::readDefinitions()
 void Cluster::createComponents()
 {
     rootComponent_ = Component::populateTree(*dataDef_, *this);
-    basic_components_pr_.set_value();
+
+    decltype(onComponentsCreated_) pending;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        componentsCreated_ = true;
+        pending.swap(onComponentsCreated_);
+    }
+
+    // We are on our io-thread
+    for(auto& fn : pending) {
+        fn();
+    }
+}
+
+void Cluster::whenComponentsCreated(std::function<void ()> fn)
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        if (!componentsCreated_) {
+            onComponentsCreated_.push_back(move(fn));
+            return;
+        }
+    }
+
+    client_->GetIoService().post(move(fn));
 }
 
 void Cluster::setCmds()
@@ -475,7 +573,17 @@ void Cluster::setCmds()
     case Engine::Mode::DEPLOY:
         verb_ = "Deploying";
         executeCmd_ = [this] {
-            return rootComponent_->deploy();
+            return deploy();
+        };
+        prepareCmd_ = [this] {
+            rootComponent_->prepare();
+            return dummyReturnFuture();
+        };
+        break;
+    case Engine::Mode::UPDATE:
+        verb_ = "Updating";
+        executeCmd_ = [this] {
+            return deploy();
         };
         prepareCmd_ = [this] {
             rootComponent_->prepare();
@@ -502,6 +610,16 @@ void Cluster::setCmds()
                 return dummyReturnFuture();
             };
         break;
+    case Engine::Mode::SIMULATE:
+            verb_ = "Simulating";
+            executeCmd_ = [this] {
+                return simulate();
+            };
+            prepareCmd_ = [this] {
+                rootComponent_->prepare();
+                return dummyReturnFuture();
+            };
+        break;
     }
 }
 
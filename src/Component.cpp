@@ -1,10 +1,12 @@
 
+#include <fstream>
 #include <map>
 #include <algorithm>
 #include <queue>
+#include <random>
+#include <unordered_map>
 
 #include <boost/algorithm/string.hpp>
-#include <boost/process.hpp>
 
 #include "restc-cpp/RequestBuilder.h"
 
@@ -17,20 +19,25 @@
 #include "k8deployer/DaemonSetComponent.h"
 #include "k8deployer/DeploymentComponent.h"
 #include "k8deployer/Engine.h"
+#include "k8deployer/EventIndex.h"
 #include "k8deployer/HttpRequestComponent.h"
 #include "k8deployer/IngressComponent.h"
 #include "k8deployer/JobComponent.h"
+#include "k8deployer/MacroTemplate.h"
 #include "k8deployer/NamespaceComponent.h"
 #include "k8deployer/PersistentVolumeComponent.h"
 #include "k8deployer/RoleBindingComponent.h"
 #include "k8deployer/RoleComponent.h"
+#include "k8deployer/Scheduler.h"
 #include "k8deployer/SecretComponent.h"
 #include "k8deployer/ServiceAccountComponent.h"
 #include "k8deployer/ServiceComponent.h"
 #include "k8deployer/StatefulSetComponent.h"
+#include "k8deployer/Watch.h"
 #include "k8deployer/k8/k8api.h"
 #include "k8deployer/logging.h"
 #include "k8deployer/exprtk_fn.h"
+#include "k8deployer/yaml_fn.h"
 
 using namespace std;
 using namespace string_literals;
@@ -132,6 +139,19 @@ Kind toKind(const string &kind)
     return kinds.at(kind);
 }
 
+bool isClusterScoped(Kind kind)
+{
+    switch(kind) {
+    case Kind::NAMESPACE:
+    case Kind::PERSISTENTVOLUME:
+    case Kind::CLUSTERROLE:
+    case Kind::CLUSTERROLEBINDING:
+        return true;
+    default:
+        return false;
+    }
+}
+
 string Component::toString(const Kind &kind)
 {
     for(const auto& [k, v] : kinds) {
@@ -192,6 +212,61 @@ std::string Base64Encode(const std::string &in) {
     return out;
 }
 
+namespace {
+const string fingerprintPlaceholder(16, '0');
+
+// What we need from the reply to an apply
+struct AppliedObject {
+    k8api::ObjectMeta metadata;
+};
+
+struct ObjectPage {
+    k8api::ListMeta metadata;
+    std::vector<AppliedObject> items;
+};
+
+} // anon ns
+} // ns
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::AppliedObject,
+    (k8deployer::k8api::ObjectMeta, metadata)
+);
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::ObjectPage,
+    (k8deployer::k8api::ListMeta, metadata)
+    (std::vector<k8deployer::AppliedObject>, items)
+);
+
+namespace k8deployer {
+
+void prepareFingerprint(k8api::ObjectMeta &meta)
+{
+    meta.annotations[fingerprintAnnotation] = fingerprintPlaceholder;
+}
+
+string stampFingerprint(string &json)
+{
+    const auto key = "\""s + fingerprintAnnotation + "\":\"" + fingerprintPlaceholder + '"';
+    const auto pos = json.find(key);
+    if (pos == string::npos) {
+        return {};
+    }
+
+    // 64 bit FNV-1a. Stable across builds and platforms.
+    uint64_t hash = 0xcbf29ce484222325;
+    for(const uint8_t c : json) {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+
+    ostringstream out;
+    out << hex << setw(16) << setfill('0') << hash;
+    const auto value = out.str();
+
+    json.replace(pos + key.size() - value.size() - 1, value.size(), value);
+    return value;
+}
+
 string Component::toString(const Component::State &state)
 {
     static const std::array<string, 8> names = {"PRE",
@@ -212,6 +287,8 @@ Component::Component(const Component::ptr_t &parent, Cluster &cluster, const Com
 {
 }
 
+Component::~Component() = default;
+
 string Component::toString(const Component::ParentRelation &rel)
 {
     static const std::array<string, 3> names = {"INDEPENDENT", "BEFORE", "AFTER"};
@@ -411,6 +488,49 @@ int Component::getIntArg(const string &name, int defaultVal) const
     return defaultVal;
 }
 
+double Component::getDoubleArg(const string &name, double defaultVal) const
+{
+    auto v = getArg(name);
+    if (v && !v.value().empty()) {
+        return stod(*v);
+    }
+
+    return defaultVal;
+}
+
+Component::PollConfig Component::getPollConfig() const
+{
+    PollConfig pc;
+
+    switch(kind_) {
+    case Kind::STATEFULSET:
+    case Kind::JOB:
+        pc.initial = chrono::milliseconds{1000};
+        pc.max = chrono::milliseconds{10000};
+        break;
+    case Kind::DEPLOYMENT:
+    case Kind::DAEMONSET:
+        pc.initial = chrono::milliseconds{500};
+        pc.max = chrono::milliseconds{5000};
+        break;
+    default:
+        pc.initial = chrono::milliseconds{100};
+        pc.max = chrono::milliseconds{2000};
+    }
+
+    const auto kindPrefix = "poll."s + toString(kind_) + ".";
+    auto get = [&](const string& name, auto defaultVal) {
+        // The Kind specific arg wins over the generic one
+        return getDoubleArg(kindPrefix + name, getDoubleArg("poll." + name, defaultVal));
+    };
+
+    pc.initial = chrono::milliseconds{static_cast<int64_t>(get("initial.ms", pc.initial.count()))};
+    pc.max = chrono::milliseconds{static_cast<int64_t>(get("max.ms", pc.max.count()))};
+    pc.backoff = max(get("backoff", pc.backoff), 1.0);
+    pc.max = max(pc.max, pc.initial);
+    return pc;
+}
+
 size_t Component::getSizetArg(const string &name, size_t defaultVal) const
 {
     auto v = getArg(name);
@@ -434,21 +554,40 @@ Component::ptr_t Component::populateTree(ComponentDataDef &def, Cluster &cluster
 void Component::prepare()
 {
     tasks_ = make_unique<tasks_t>();
+    DependencyGraph graph;
     switch(Engine::mode()) {
     case Engine::Mode::DEPLOY:
+    case Engine::Mode::UPDATE:
     case Engine::Mode::SHOW_DEPENDENCIES:
+    case Engine::Mode::SIMULATE:
         prepareDeploy();
         addDeploymentTasks(*tasks_);
-        prepareTasks(*tasks_, false);
+        graph = prepareTasks(*tasks_, false);
         scanDependencies();
         break;
     case Engine::Mode::DELETE:
         prepareDeploy();
-        addRemovementTasks(*tasks_);
-        prepareTasks(*tasks_, true);
+        if (const auto& mode = Engine::config().deleteMode; mode == "collection") {
+            addCollectionRemovementTasks(*tasks_);
+        } else if ((mode == "namespace" || mode == "auto") && ownsItsNamespaces()) {
+            LOG_INFO << logName() << "All the components are in namespaces we manage. Deleting the namespaces.";
+            addNamespaceRemovementTasks(*tasks_);
+        } else if (mode == "namespace") {
+            LOG_ERROR << logName() << "--delete-mode namespace: Some components are in namespaces we don't manage.";
+            throw runtime_error("Cannot delete by namespace");
+        } else {
+            addRemovementTasks(*tasks_);
+        }
+        graph = prepareTasks(*tasks_, true);
         scanDependencies();
         break;
     }
+
+    checkForCircularDependencies();
+    scheduler_ = make_unique<Scheduler>(*tasks_, move(graph));
+    forAllComponents([this](Component& c) {
+        scheduler_->touch(c, true);
+    });
 }
 
 void Component::prepareDeploy()
@@ -464,6 +603,12 @@ std::future<void> Component::deploy()
     return execute();
 }
 
+void Component::deploy(std::shared_ptr<std::promise<void>> done)
+{
+    assert(isRoot());
+    execute(move(done));
+}
+
 std::future<void> Component::dumpDependencies()
 {
     const auto dotName = name + "-" + Engine::config().dotfile;
@@ -477,11 +622,9 @@ std::future<void> Component::dumpDependencies()
         out << R"(      label="Components";)" << endl;
 
         forAllComponents([&](Component& c) {
-            for (const auto& dep : c.dependsOn_) {
-                if (auto d = dep.lock()) {
-                    out << "      \"" << boost::trim_right_copy(c.logName())
-                        << "\" -> \"" << boost::trim_right_copy(d->logName()) << '"' << endl;
-                }
+            for (const auto d : c.dependsOn_) {
+                out << "      \"" << boost::trim_right_copy(c.logName())
+                    << "\" -> \"" << boost::trim_right_copy(d->logName()) << '"' << endl;
             }
         });
 
@@ -492,13 +635,11 @@ std::future<void> Component::dumpDependencies()
             out << R"(      label="Tasks";)" << endl;
 
             for(const auto& t : *tasks_) {
-                for (const auto& dw: t->dependencies()) {
-                    if (auto d = dw.lock()) {
-                        out << "      \"" << boost::trim_right_copy(t->component().logName()) << '.' << t->name()
-                            << "\" -> \""
-                            << boost::trim_right_copy(d->component().logName()) << '.' << d->name()
-                            << '"' << endl;
-                    }
+                for (const auto d : t->dependencies()) {
+                    out << "      \"" << boost::trim_right_copy(t->component().logName()) << '.' << t->name()
+                        << "\" -> \""
+                        << boost::trim_right_copy(d->component().logName()) << '.' << d->name()
+                        << '"' << endl;
                 }
             }
 
@@ -518,28 +659,44 @@ std::future<void> Component::remove()
 
 std::future<void> Component::execute()
 {
+    auto pr = make_shared<promise<void>>();
+    auto future = pr->get_future();
+    execute(move(pr));
+    return future;
+}
+
+void Component::execute(std::shared_ptr<std::promise<void>> done)
+{
+    executionPromise_ = move(done);
+
     // Execute via asio's executor
     cluster().client().GetIoService().post([self = weak_from_this()] {
        if (auto component = self.lock()) {
            component->runTasks();
        }
     });
-
-    executionPromise_ = make_unique<promise<void>>();
-    return executionPromise_->get_future();
 }
 
-void Component::onEvent(const std::shared_ptr<k8api::Event>& event)
+void Component::onEvent(const std::shared_ptr<k8api::Event>& event, std::vector<Task::wptr_t> tasks)
 {
     if (tasks_) {
-        cluster_->client().GetIoService().post([event, self = weak_from_this()] {
+        cluster_->client().GetIoService().post([event, tasks=move(tasks), self = weak_from_this()] {
             if (auto component = self.lock()) {
-                component->processEvent(*event);
+                component->processEvent(*event, tasks);
             }
         });
     }
 }
 
+EventIndex &Component::getEventIndex()
+{
+    auto& root = getRoot();
+    if (!root.eventIndex_) {
+        root.eventIndex_ = make_unique<EventIndex>();
+    }
+    return *root.eventIndex_;
+}
+
 labels_t::value_type Component::getSelector()
 {
     if (auto selector = labels.find("app"); selector != labels.end()) {
@@ -556,6 +713,14 @@ void Component::scheduleRunTasks()
         return;
     }
 
+    if (auto scheduler = getScheduler()) {
+        scheduler->touch(*this, true);
+        if (scheduler->runPending) {
+            return;
+        }
+        scheduler->runPending = true;
+    }
+
     schedule([wself = getRoot().weak_from_this()] {
        if (auto self = wself.lock()) {
            self->runTasks();
@@ -582,37 +747,29 @@ void Component::schedule(std::function<void ()> fn)
 void Component::schedule(std::function<void ()> fn, int afterSeconds)
 {
   assert(fn);
-  auto timer = make_shared<boost::asio::deadline_timer>(cluster().client().GetIoService());
-  timer->expires_from_now(boost::posix_time::seconds(afterSeconds));
-  auto w = weak_from_this();
-  auto started = time({});
-  timer->async_wait([timer, w=weak_from_this(), fn=std::move(fn), started](auto ec) {
-      const auto elapsed = time({}) - started;
-      if (auto self = w.lock()) {
-          if (ec) {
-              LOG_WARN << "Component::schedule::timer " << "Error: " << ec.message();
-              return;
-          }
-
-          try {
-              fn();
-          } catch(const std::exception& ex) {
-              LOG_ERROR << self->logName()
-                        <<  "Caught exception from Component::schedule::timer: " << ex.what();
+  // May be called from another clusters thread (delay.sequence), so add the timer from our own
+  schedule([this, fn=std::move(fn), afterSeconds]() mutable {
+      cluster().timers().schedule(chrono::seconds{afterSeconds},
+                                  [w=weak_from_this(), fn=std::move(fn)] {
+          if (auto self = w.lock()) {
+              try {
+                  fn();
+              } catch(const std::exception& ex) {
+                  LOG_ERROR << self->logName()
+                            <<  "Caught exception from Component::schedule::timer: " << ex.what();
+              }
           }
-      }
+      });
   });
 }
 
 bool Component::isBlockedOnDependency() const
 {
     if (mode_ == Mode::CREATE) {
-        for(const auto& wcomp : dependsOn_) {
-            if (auto comp = wcomp.lock()) {
-                if (comp->state_ < State::DONE) {
-                    LOG_TRACE << logName() << "isBlockedOnDependency: is still blocked on " << comp->logName();
-                    return true;
-                }
+        for(const auto comp : dependsOn_) {
+            if (comp->state_ < State::DONE) {
+                LOG_TRACE << logName() << "isBlockedOnDependency: is still blocked on " << comp->logName();
+                return true;
             }
         }
 
@@ -705,34 +862,37 @@ void Component::scanDependencies()
         if (isClusterVal) {
             if (auto cluster = Engine::instance().getCluster(clusterIx)) {
 
-                // Give the cluster a chance to initialize it's components
-                cluster->getBasicComponentsReady().wait();
-
+                // Add reference to it so we wait for it
                 auto ref = make_unique<DependencyReference>();
                 ref->name = depName;
+                auto dep = ref.get();
+                clusterDependencies_.emplace_back(move(ref));
+                LOG_DEBUG << logName() << "Added dependency to " << depName;
+
+                // Our inbox gets the state changes from the other cluster.
+                cluster_->stateBus().subscribe(*cluster, componentName, *this,
+                                               [this, dep](StateBus::state_t st) {
+                    LOG_TRACE << logName() << "State change for " << dep->name
+                              << ", state was " << static_cast<int>(dep->state)
+                              << ", changing to " << st;
+                    dep->state = static_cast<State>(st);
+                });
 
-                if (cluster->addStateListener(componentName,
-                                              [this, dep=ref.get()](const Component& component) {
-
-                     auto st = component.getState();
-
-                     LOG_TRACE << logName() << "State Listener called on " << dep->name << ", state=" << static_cast<int>(st);
-
-                     // Called from the other components io thread.
-                     // We need to continue in our own thread.
-                     schedule([this, dep, st] {
+                // The other cluster may still be creating it's components. Continue
+                // in it's io-thread when they are ready, rather than blocking ours.
+                cluster->whenComponentsCreated([this, cluster, dep, target=componentName] {
+                    if (auto c = cluster->getComponent(target)) {
+                        c->addSubscriber(cluster_->stateBus());
+                        return;
+                    }
 
-                        LOG_TRACE << logName() << "State Listener called on " << dep->name
-                              << ", state was " << static_cast<int>(dep->state)
-                              << ", changing to " << static_cast<int>(st);
-                        dep->state = st;
+                    // Like before, a reference to a missing component is ignored
+                    LOG_WARN << logName() << "No component named " << target << " in " << dep->name;
+                    schedule([this, dep] {
+                        dep->state = State::DONE;
                         scheduleRunTasks();
-                  });
-                })) {
-                    // Add reference to it so we wait for it
-                    LOG_DEBUG << logName() << "Added dependency to " << ref->name;
-                    clusterDependencies_.emplace_back(move(ref));
-                }
+                    });
+                });
 
             } else {
                 // TODO: Should we accept this and just complain??
@@ -781,6 +941,11 @@ Component &Component::getRoot()
     return *root;
 }
 
+Scheduler *Component::getScheduler()
+{
+    return getRoot().scheduler_.get();
+}
+
 bool Component::evaluate()
 {
     const auto oldState = state_;
@@ -794,17 +959,10 @@ bool Component::evaluate()
         return oldState != state_;
     }
 
-    if (auto& t = getRoot().tasks_) {
+    if (getRoot().tasks_) {
         bool allDone = true;
-        size_t numTasks = 0;
-        for(const auto& task : *t) {
-
-            // Filter on tasks for this component
-            if (&task->component() != this) {
-                continue;
-            }
-
-            ++numTasks;
+        const size_t numTasks = ownTasks_.size();
+        for(const auto task : ownTasks_) {
 
             if (task->state() >= Task::TaskState::BLOCKED && state_ <= State::BLOCKED) {
                 newState = State::RUNNING;
@@ -866,37 +1024,89 @@ string Component::getNamespace() const
     return Engine::config().ns;
 }
 
-void Component::startElapsedTimer()
+std::set<string> Component::getCollectionUrls()
 {
-    if (!startTime) {
-      startTime = chrono::steady_clock::now();
-    }
+    std::set<string> urls;
+
+    forAllComponents([&urls](Component& c) {
+        switch(c.kind_) {
+        case Kind::APP:
+        case Kind::HTTP_REQUEST:
+            return; // Not k8s objects
+        default:
+            urls.insert(c.getCreationUrl());
+        }
+    });
+
+    return urls;
 }
 
-void Component::addDependenciesRecursively(std::set<Component *> &contains)
+std::set<string> Component::getNamespaces()
 {
-    for(auto& w: dependsOn_) {
-        if (auto c = w.lock()) {
-            if (contains.insert(c.get()).second) {
-                c->addDependenciesRecursively(contains);
+    std::set<string> namespaces;
+    forAllComponents([&namespaces](Component& c) {
+        switch(c.kind_) {
+        case Kind::APP:
+        case Kind::NAMESPACE:
+        case Kind::PERSISTENTVOLUME:
+        case Kind::CLUSTERROLE:
+        case Kind::CLUSTERROLEBINDING:
+        case Kind::HTTP_REQUEST:
+            return; // Not namespaced objects
+        default:
+            if (auto ns = c.getNamespace(); !ns.empty()) {
+                namespaces.insert(ns);
             }
         }
+    });
+
+    return namespaces;
+}
+
+void Component::startElapsedTimer()
+{
+    if (!startTime) {
+      startTime = chrono::steady_clock::now();
+
+      if (auto seconds = getIntArg("timeout.component.seconds", 0); seconds > 0) {
+          deadline_ = cluster().timers().schedule(chrono::seconds{seconds}, [w=weak_from_this(), seconds] {
+              if (auto self = w.lock()) {
+                  self->deadline_ = 0;
+                  if (self->state_ >= State::DONE) {
+                      return;
+                  }
+
+                  const auto reason = "The component timed out after "s + to_string(seconds)
+                          + " seconds (timeout.component.seconds)";
+                  for(auto task : self->ownTasks_) {
+                      if (!task->isDone()) {
+                          task->fail(reason);
+                      }
+                  }
+              }
+          });
+      }
     }
 }
 
-void Component::processEvent(const k8api::Event& event)
+void Component::processEvent(const k8api::Event& event, const std::vector<Task::wptr_t>& tasks)
 {
     assert(tasks_);
     bool changed = false;
-    for(auto& task : *tasks_) {
-        changed = task->onEvent(event) ? true : changed;
-        if (changed) {
+    for(const auto& w : tasks) {
+        auto task = w.lock();
+        if (!task || !task->isMonitoring()) {
+            continue;
+        }
+
+        if (task->onEvent(event)) {
+            changed = true;
             LOG_TRACE << logName() << " Task " << task->name() << " changed state. Will schedule a re-run of the tasks.";
         }
     }
 
     if (changed) {
-        cluster_->client().GetIoService().post([event, self = weak_from_this()] {
+        cluster_->client().GetIoService().post([self = weak_from_this()] {
             if (auto component = self.lock()) {
                 component->runTasks();
             }
@@ -910,36 +1120,40 @@ void Component::runTasks() {
         return;
     }
 
-    // Re-run the loop as long as any task changes it's state
+    assert(scheduler_);
+    scheduler_->runPending = false;
+
+    // Only re-evaluate what was affected by state-changes since the last round.
     while(cluster_->isExecuting() && ! isDone()) {
-        LOG_TRACE << logName() << "runTasks: Iterating over Components";
+        if (auto c = scheduler_->nextComponent()) {
+            c->evaluate();
+            continue;
+        }
 
-        bool componentChanged = false;
-        forAllComponents([&](Component& c){
-            componentChanged |= c.evaluate();
-        });
+        if (auto task = scheduler_->nextTask()) {
+            if (task->evaluate()) {
+                scheduler_->touch(*task);
+                scheduler_->touch(task->component());
+            }
+            if (task->state() == Task::TaskState::READY) {
+                scheduler_->setReady(*task);
+            }
+            continue;
+        }
 
-        LOG_TRACE << logName() << "runTasks: Iterating over tasks. componentChanged=" << componentChanged;
-        bool again = componentChanged;
-        bool allDone = true;
-        assert(tasks_);
-        for(auto task : *tasks_) {
-            again = task->evaluate() ? true : again;
+        if (auto task = scheduler_->nextReady()) {
+            // The state may have changed since it was queued
             if (task->state() == Task::TaskState::READY) {
                 task->execute();
-                again = true;
             }
-
-            allDone = task->isDone() ? allDone : false;
+            continue;
         }
 
-        if (!again) {
-            // TODO: Add timer so we can time out if we don't catch or get
-            // events to move the states to DONE.
+        // Tasks that never reach DONE are failed by their deadlines
+        // (timeout.seconds, timeout.component.seconds)
 
-            LOG_TRACE << logName() << "runTasks: Finished iterations for now ...";
-            return;
-        }
+        LOG_TRACE << logName() << "runTasks: Finished iterations for now ...";
+        return;
     }
 
     // TODO: Deal with incomplete state if we are not finished
@@ -959,7 +1173,7 @@ void Component::setIsDone()
         return;
     }
 
-    if (Engine::instance().mode() == Engine::Mode::DEPLOY) {
+    if (Engine::isApplying()) {
         // Deal with "delay.after" timer
         if (delayAfterTimerExceuted_ && !*delayAfterTimerExceuted_) {
             // Wait for the timer to finish
@@ -989,7 +1203,7 @@ void Component::setCanRun()
         return;
     }
 
-    if (Engine::instance().mode() == Engine::Mode::DEPLOY) {
+    if (Engine::isApplying()) {
         // Deal with "delay.before" timer
         if (delayBeforeTimerExceuted_ && !*delayBeforeTimerExceuted_) {
             // Wait for the timer to finish
@@ -1058,7 +1272,7 @@ void Component::setState(Component::State state)
             executionPromise_.reset();
         }
 
-        if (Engine::instance().mode() == Engine::Mode::DEPLOY) {
+        if (Engine::isApplying()) {
             if (auto url = getArg("openInBrowser")) {
                 if (!Engine::config().webBrowser.empty()) {
                     auto cmd = Engine::config().webBrowser + " " + *url + " &";
@@ -1080,6 +1294,10 @@ void Component::setState(Component::State state)
 
     state_ = state;
 
+    if (auto scheduler = getScheduler()) {
+        scheduler->onStateChanged(*this);
+    }
+
     if (state_ >= State::RUNNING && (state_ != State::PRE_TIMER && state_ != State::POST_TIMER)) {
         if (auto parent = parent_.lock()) {
             parent->evaluate();
@@ -1087,16 +1305,9 @@ void Component::setState(Component::State state)
         scheduleRunTasks();
     }
 
-    // Call state listeners
-    decltype(stateListeners_) copy;
-    {
-        lock_guard<mutex> lock_{mutex_};
-        copy = stateListeners_;
-    }
-    for(auto const& fn : copy) {
-        if (fn) {
-            fn(*this);
-        }
+    // Notify the clusters that depend on us
+    for(auto bus : subscribers_) {
+        bus->publish(*this, static_cast<StateBus::state_t>(state_));
     }
 }
 
@@ -1127,16 +1338,29 @@ Component::ptr_t Component::getAppComponent()
 
 
 string execFunction(const string &name, const string &arg)
+{
+    if (isExpressionFunction(name)) {
+        return execFunction(name, exprtkDouble(arg));
+    }
+
+    LOG_ERROR << "Unknown function name: " << name;
+    throw runtime_error{"Unknown function"};
+}
+
+bool isExpressionFunction(const string &name)
+{
+    return name == "eval" || name == "intexpr" || name == "expr";
+}
+
+string execFunction(const string &name, double result)
 {
     if (name == "eval") {
         // Return a boolean result from the expression
-        auto result = exprtkDouble(arg);
         return static_cast<int>(result) ? "true" : "false";
     } else if (name == "intexpr") {
-        auto result = exprtkDouble(arg);
         return to_string(static_cast<int>(result));
     } else if (name == "expr") {
-          return to_string(exprtkDouble(arg));
+          return to_string(result);
     } else {
         LOG_ERROR << "Unknown function name: " << name;
         throw runtime_error{"Unknown function"};
@@ -1408,10 +1632,14 @@ Component::ptr_t Component::addChild(const string &name, Kind kind, const labels
     return component;
 }
 
-void Component::addStateListener(const std::function<void (const Component &)>& fn)
+void Component::addSubscriber(StateBus &bus)
 {
-    lock_guard<mutex> lock_{mutex_};
-    stateListeners_.emplace_back(fn);
+    if (find(subscribers_.begin(), subscribers_.end(), &bus) == subscribers_.end()) {
+        subscribers_.push_back(&bus);
+    }
+
+    // It's state may have changed before the subscriber was added
+    bus.publish(*this, static_cast<StateBus::state_t>(state_));
 }
 
 conf_t Component::mergeArgs() const
@@ -1460,10 +1688,29 @@ bool Component::Task::setState(Component::Task::TaskState state, bool scheduleRu
               << toString(state_) << " to " << toString(state);
 
     const bool changed = state_ != state;
+    const auto prev = state_;
     state_ = state;
 
+    if (changed) {
+        if (auto scheduler = component().getScheduler()) {
+            scheduler->onStateChanged(*this, prev, state);
+        }
+    }
+
     if (changed && state == TaskState::EXECUTING) {
       component().startElapsedTimer();
+      startDeadline();
+      if (!executingSince_) {
+          executingSince_ = chrono::steady_clock::now();
+      }
+    }
+
+    if (changed && state == TaskState::DONE && executingSince_) {
+        elapsed_ = chrono::duration<double>(chrono::steady_clock::now() - *executingSince_).count();
+    }
+
+    if (changed && state >= TaskState::DONE) {
+        cancelTimers();
     }
 
     if (state == TaskState::DONE) {
@@ -1500,35 +1747,21 @@ bool Component::Task::evaluate()
             }
         }
 
-        bool blocked = false;
-
-        for(const auto& dep : dependencies_) {
-            // If any dependencies is not DONE, we are still blocked.
-            if (auto dt = dep.lock()) {
-                blocked = dt->state() == TaskState::DONE ? blocked : true;
-
-                if (dt->state() != TaskState::DONE) {
-                    blocked = true;
-                    LOG_TRACE << component().logName()
-                              << "task " << name()
-                              << " is blocked on task "
-                              << dt->component().logName()
-                              << '/' << dt->name();
-                }
-
-                if (dt->state() >= TaskState::ABORTED) {
-                    // If a dependency failed, we abort.
-                    // TODO: Deal with roll-backs
-                    setState(TaskState::DEPENDENCY_FAILED, false);
-                    return true;
-                }
-            }
+        if (failedDependencies_) {
+            // If a dependency failed, we abort.
+            // TODO: Deal with roll-backs
+            setState(TaskState::DEPENDENCY_FAILED, false);
+            return true;
         }
 
-        if (!blocked) {
+        if (pendingDependencies_ == 0) {
             setState(TaskState::READY, false);
             component().evaluate();
             changed = true;
+        } else {
+            LOG_TRACE << component().logName()
+                      << "task " << name()
+                      << " is blocked on " << pendingDependencies_ << " dependencies";
         }
     } // if BLOCKED
 
@@ -1539,61 +1772,129 @@ void Component::Task::schedulePoll()
 {
     component().schedule([wself = weak_from_this()] {
         if (auto self = wself.lock()) {
-            if (!self->pollTimer_) {
-                self->pollTimer_ = make_unique<boost::asio::deadline_timer>(
-                            self->component().cluster().client().GetIoService(),
-                            boost::posix_time::seconds{2});
-                self->pollTimer_->async_wait([wself](auto err) {
-                    if (auto self = wself.lock()) {
-                        self->pollTimer_.reset();
-                        if (err) {
-                            LOG_WARN << self->component().logName()
-                                     << "Got error from timer for task: " << err;
-                            return;
-                        }
+            if (!self->component().cluster().timers().isPending(self->pollTimer_)) {
+                static thread_local std::mt19937 rnd{std::random_device{}()};
+                const auto pc = self->component().getPollConfig();
 
-                        if (!self->component().probe([wself](auto state) {
-                            if (auto self = wself.lock()) {
-                                if (self->mode() == Mode::REMOVE) {
-                                   if (state == K8ObjectState::DONT_EXIST || state == K8ObjectState::DONE) {
-                                       self->setState(TaskState::DONE);
-                                       self->component().scheduleRunTasks();
-                                       return;
-                                   }
-                                   if (state == K8ObjectState::FAILED) {
-                                        self->setState(TaskState::FAILED);
-                                        self->component().scheduleRunTasks();
-                                        return;
-                                   }
-                                   self->schedulePoll();
-                                   return;
-                                }
-                                switch(state) {
-                                    case K8ObjectState::FAILED:
-                                        self->setState(TaskState::FAILED);
-                                        self->component().scheduleRunTasks();
-                                        break;
-                                    case K8ObjectState::DONT_EXIST:
-                                    case K8ObjectState::INIT:
-                                        self->schedulePoll();
-                                        break;
-                                    case K8ObjectState::READY:
-                                    case K8ObjectState::DONE:
-                                        self->setState(TaskState::DONE);
-                                        self->component().scheduleRunTasks();
-                                }
-                            }
-                        })) {
-                            // Probes unavailable
-                            LOG_DEBUG << self->component().logName() << "Probes not available";
-                        }
+                if (self->pollInterval_.count() == 0) {
+                    self->pollInterval_ = pc.initial;
+                } else {
+                    self->pollInterval_ = min(pc.max, chrono::milliseconds{
+                        static_cast<int64_t>(self->pollInterval_.count() * pc.backoff)});
+                }
+
+                // +/- 20% jitter, so we don't probe lots of objects in lock-step
+                std::uniform_real_distribution<double> jitter{0.8, 1.2};
+                self->startPollTimer(chrono::milliseconds{
+                    static_cast<int64_t>(self->pollInterval_.count() * jitter(rnd))});
+            }
+        }
+    });
+}
+
+void Component::pollNow()
+{
+    for(auto task : ownTasks_) {
+        task->pollNow();
+    }
+}
+
+void Component::Task::pollNow()
+{
+    if (!component().cluster().timers().cancel(pollTimer_)) {
+        // Not polling, or the probe is already in progress
+        return;
+    }
+
+    LOG_TRACE << component().logName() << "Task " << name() << " will probe now.";
+    pollTimer_ = 0;
+    pollInterval_ = {};
+    startPollTimer(chrono::milliseconds{0});
+}
+
+void Component::Task::startPollTimer(chrono::milliseconds delay)
+{
+    auto& timers = component().cluster().timers();
+    assert(!timers.isPending(pollTimer_));
+    pollTimer_ = timers.schedule(delay, [wself = weak_from_this()] {
+        if (auto self = wself.lock()) {
+            self->pollTimer_ = 0;
+
+            if (!self->component().probe([wself](auto state) {
+                if (auto self = wself.lock()) {
+                    if (self->mode() == Mode::REMOVE) {
+                       if (state == K8ObjectState::DONT_EXIST || state == K8ObjectState::DONE) {
+                           self->setState(TaskState::DONE);
+                           self->component().scheduleRunTasks();
+                           return;
+                       }
+                       if (state == K8ObjectState::FAILED) {
+                            self->setState(TaskState::FAILED);
+                            self->component().scheduleRunTasks();
+                            return;
+                       }
+                       self->schedulePoll();
+                       return;
                     }
-                });
+                    switch(state) {
+                        case K8ObjectState::FAILED:
+                            self->setState(TaskState::FAILED);
+                            self->component().scheduleRunTasks();
+                            break;
+                        case K8ObjectState::DONT_EXIST:
+                        case K8ObjectState::INIT:
+                            self->schedulePoll();
+                            break;
+                        case K8ObjectState::READY:
+                        case K8ObjectState::DONE:
+                            self->setState(TaskState::DONE);
+                            self->component().scheduleRunTasks();
+                    }
+                }
+            })) {
+                // Probes unavailable
+                LOG_DEBUG << self->component().logName() << "Probes not available";
             }
         }
     });
 }
 
+void Component::Task::fail(const string &reason)
+{
+    if (isDone()) {
+        return;
+    }
+
+    failureReason_ = reason;
+    LOG_ERROR << component().logName() << "Task " << name() << " failed: " << reason;
+    setState(TaskState::FAILED);
+}
+
+void Component::Task::startDeadline()
+{
+    const auto seconds = component().getIntArg("timeout.seconds", Engine::config().taskTimeoutSeconds);
+    if (seconds <= 0 || deadline_) {
+        return;
+    }
+
+    deadline_ = component().cluster().timers().schedule(chrono::seconds{seconds},
+                                                       [wself = weak_from_this(), seconds] {
+        if (auto self = wself.lock()) {
+            self->deadline_ = 0;
+            self->fail("Timed out after "s + to_string(seconds) + " seconds in state "
+                       + toString(self->state()) + " (timeout.seconds)");
+        }
+    });
+}
+
+void Component::Task::cancelTimers()
+{
+    auto& timers = component().cluster().timers();
+    timers.cancel(pollTimer_);
+    timers.cancel(deadline_);
+    pollTimer_ = deadline_ = 0;
+}
+
 string Component::toString(const Component::Task::TaskState &state) {
     static const array<string, 9> names = { "PRE",
                                             "BLOCKED",
@@ -1608,24 +1909,9 @@ string Component::toString(const Component::Task::TaskState &state) {
     return names.at(static_cast<size_t>(state));
 }
 
-void Component::Task::addDependency(const Component::Task::wptr_t &task) {
-    if (auto t = task.lock()) {
-        for(auto wd: dependencies_) {
-            if (wd.lock() == t) {
-                return; // Already there
-            }
-        }
-        dependencies_.push_back(task);
-    }
-}
-
-void Component::Task::addAllDependencies(std::set<Component::Task *> &tasks)
-{
-    for(auto& d : dependencies_) {
-        if (auto dep = d.lock()) {
-            tasks.insert(dep.get());
-            dep->addAllDependencies(tasks);
-        }
+void Component::Task::addDependency(Component::Task &task) {
+    if (find(dependencies_.begin(), dependencies_.end(), &task) == dependencies_.end()) {
+        dependencies_.push_back(&task);
     }
 }
 
@@ -1644,7 +1930,6 @@ const JsonFieldMapping *jsonFieldMappings()
 string fileToJson(const string &pathToFile, bool assumeYaml,
                   const input_processor_t& inputPreprocessor)
 {
-    static atomic_int cnt{0};
     if (!filesystem::is_regular_file(pathToFile)) {
         LOG_ERROR << "Not a file: " << pathToFile;
         throw runtime_error("Not a file: "s + pathToFile);
@@ -1654,51 +1939,12 @@ string fileToJson(const string &pathToFile, bool assumeYaml,
     const filesystem::path path{pathToFile};
     const auto ext = path.extension();
     if (assumeYaml || ext == ".yaml") {
-
-        auto inputPath = pathToFile;
-        bool cleanUp = false;
-
+        auto yaml = slurp(pathToFile);
         if (inputPreprocessor) {
-           auto tmpPath = std::filesystem::temp_directory_path();
-           tmpPath /= "k8deployer-"s + to_string(getpid()) + "-" + to_string(++cnt) + ".yaml";
-           inputPath = tmpPath.string();
-
-           std::ofstream tmp{inputPath};
-           if (!tmp.is_open()) {
-              LOG_ERROR << "Failed to open " << inputPath << " for write.";
-              throw runtime_error{"Failed to pen tmp file for wtite"};
-           }
-           LOG_TRACE << "Writing tmp yaml file to " << inputPath;
-           tmp << inputPreprocessor(slurp(pathToFile));
-           cleanUp = true;
-        }
-
-        // https://www.commandlinefu.com/commands/view/12218/convert-yaml-to-json
-        // fix : https://stackoverflow.com/questions/69564817/typeerror-load-missing-1-required-positional-argument-loader-in-google-col
-        const auto expr = R"(import sys, yaml, json; json.dump(yaml.safe_load(open(")"s
-                + inputPath
-                + R"(","r").read()), sys.stdout, indent=4))"s;
-        auto args = boost::process::args({"-c"s, expr});
-        boost::process::ipstream pipe_stream;
-        boost::process::child process(boost::process::search_path("python"),
-                                      args,
-                                      boost::process::std_out > pipe_stream);
-        string line;
-        while (pipe_stream && std::getline(pipe_stream, line)) {
-            json += line;
-        }
-
-        error_code ec;
-        process.wait(ec);
-
-        if (cleanUp) {
-            filesystem::remove(inputPath);
+            yaml = inputPreprocessor(yaml);
         }
 
-        if (ec) {
-            LOG_ERROR << "Failed to convert yaml from " << pathToFile << ": " << ec.message();
-            throw runtime_error("Failed to convert yaml: "s + pathToFile);
-        }
+        json = yamlToJson(yaml, pathToFile);
 
     } else if (ext == ".json") {
         json = slurp(pathToFile);
@@ -1713,17 +1959,158 @@ string fileToJson(const string &pathToFile, bool assumeYaml,
     return json;
 }
 
+void Component::sendApplyJson(string json, const string &url, std::weak_ptr<Component::Task> task,
+                              const Request::Type requestType, const string& name)
+{
+    // Server-side apply creates or updates the object in one request.
+    // Json is valid yaml, so the payload is the same.
+    const bool serverSide = Engine::config().serverSideApply
+            && requestType == Request::Type::POST && !name.empty();
+
+    // Without server-side apply, `update` patches the object, and creates it if it's missing.
+    const bool update = !serverSide && Engine::mode() == Engine::Mode::UPDATE
+            && requestType == Request::Type::POST && !name.empty();
+
+    cluster_->governor().process([this, url, task, json=std::move(json), requestType, serverSide, update, name](auto& ctx) {
+        std::string taskName = "***";
+        if (auto t = task.lock()) {
+            taskName = t->name();
+        }
+
+        auto targetUrl = url;
+        auto type = requestType;
+        std::string contentType = "application/json; charset=utf-8";
+        if (serverSide) {
+            targetUrl = url + "/" + name;
+            type = Request::Type::PATCH;
+            contentType = "application/apply-patch+yaml; charset=utf-8";
+        } else if (update) {
+            targetUrl = url + "/" + name;
+            type = Request::Type::PATCH;
+            contentType = "application/merge-patch+json; charset=utf-8";
+        } else if (requestType == restc_cpp::Request::Type::PATCH) {
+            contentType = "application/merge-patch+json; charset=utf-8";
+        }
+
+        LOG_DEBUG << logName() << "Applying task " << taskName << " to " << targetUrl;
+        LOG_TRACE << logName() << "Applying payload for task " << taskName << ": " << json;
+
+        try {
+            restc_cpp::RequestBuilder builder{ctx};
+            builder.Req(targetUrl, type);
+            if (serverSide) {
+                builder.Argument("fieldManager", "k8deployer");
+                if (Engine::config().forceApply) {
+                    builder.Argument("force", "true");
+                }
+            }
+
+            auto reply = cluster_->governor().execute(builder.Header("Content-Type", contentType)
+               .Data(json));
+
+            LOG_DEBUG << logName()
+                  << "Applying task " << taskName << " gave response: "
+                  << reply->GetResponseCode() << ' '
+                  << reply->GetHttpResponse().reason_phrase;
+
+            if (auto t = task.lock(); t && t->startProbeAfterApply && t->mode() == Mode::CREATE) {
+                // Remember the generation we created, so that a rollout is not
+                // considered done based on the status of the previous generation.
+                try {
+                    serialize_properties_t sp;
+                    sp.name_mapping = jsonFieldMappings();
+                    AppliedObject applied;
+                    SerializeFromJson(applied, move(reply), sp);
+                    appliedGeneration_ = max(appliedGeneration_, applied.metadata.generation);
+                } catch(const std::exception& ex) {
+                    LOG_DEBUG << logName() << "Failed to get the generation from the reply: " << ex.what();
+                }
+            }
+
+            if (auto t = task.lock()) {
+                if (t->startProbeAfterApply /* && Engine::mode() != Engine::Mode::DELETE*/) {
+                    t->setState(Task::TaskState::WAITING);
+                    t->schedulePoll();
+                } else {
+                    // Assume that tasks that don't need polling are OK after create.
+                    t->setState(Task::TaskState::DONE);
+                }
+            }
+
+            return;
+        } catch(const restc_cpp::RequestFailedWithErrorException& err) {
+            if (RequestGovernor::isThrottled(err)) {
+                throw; // Let the governor retry
+            }
+
+            if (err.http_response.status_code == 404 && update) {
+                LOG_DEBUG << logName() << "Task " << taskName << ": The object don't exist. Creating it.";
+                sendApplyJson(json, url, task, Request::Type::POST);
+                return;
+            }
+
+            if (err.http_response.status_code == 404) {
+                if (auto t = task.lock()) {
+                    if (t->mode() == Mode::REMOVE) {
+                        LOG_DEBUG << logName()
+                                  << "Applying REMOVE task " << taskName << " to already deleted resource. Probably ok: "
+                                  << err.http_response.status_code << ' '
+                                  << err.http_response.reason_phrase;
+                        t->setState(Task::TaskState::DONE);
+                        return;
+                    }
+                }
+            }
+
+            // With server-side apply, a 409 is a conflict with another field manager
+            if (err.http_response.status_code == 409 && !serverSide) {
+                if (auto t = task.lock()) {
+                    if (t->mode() == Mode::CREATE && t->dontFailIfAlreadyExists) {
+                        LOG_DEBUG << logName()
+                                  << "Applying task " << taskName << " to existing resource. Probably ok: "
+                                  << err.http_response.status_code << ' '
+                                  << err.http_response.reason_phrase;
+                        t->setState(Task::TaskState::DONE);
+                        return;
+                    }
+                }
+            }
+
+            LOG_WARN << logName()
+                     << "Apply task " << taskName << ": Request failed: " << err.http_response.status_code
+                     << ' ' << err.http_response.reason_phrase
+                     << ": " << err.what();
+
+        } catch(const std::exception& ex) {
+            LOG_WARN << logName()
+                     << "Apply task " << taskName << ": Request failed: " << ex.what();
+        }
+
+        if (auto taskInstance = task.lock()) {
+            taskInstance->setState(Task::TaskState::FAILED);
+        }
+        setState(State::FAILED);
+
+    });
+}
+
 void Component::sendDelete(const string &url, std::weak_ptr<Component::Task> task,
                            bool ignoreErrors,
-                           const initializer_list<std::pair<string, string>>& args)
+                           std::vector<std::pair<string, string>> args)
 {
-    client().Process([this, url, task, ignoreErrors, args](auto& ctx) {
+    // The lambda is run again if the request is throttled, so it owns the args
+    cluster().governor().process([this, url, task, ignoreErrors, args=move(args)](auto& ctx) {
 
         LOG_DEBUG << logName() << "Sending DELETE " << url;
 
         try {
-            auto reply = restc_cpp::RequestBuilder{ctx}.Req(url, Request::Type::DELETE, args)
-               .Execute();
+            restc_cpp::RequestBuilder builder{ctx};
+            builder.Req(url, Request::Type::DELETE);
+            for(const auto& [name, value] : args) {
+                builder.Argument(name, value);
+            }
+
+            auto reply = cluster().governor().execute(builder);
 
             LOG_DEBUG << logName()
                   << "Delete gave response: "
@@ -1736,6 +2123,10 @@ void Component::sendDelete(const string &url, std::weak_ptr<Component::Task> tas
             }
             return;
         } catch(const restc_cpp::RequestFailedWithErrorException& err) {
+            if (RequestGovernor::isThrottled(err)) {
+                throw; // Let the governor retry
+            }
+
             if (err.http_response.status_code == 404) {
                 // Perfectly OK
                 if (auto taskInstance = task.lock()) {
@@ -1770,6 +2161,313 @@ void Component::sendDelete(const string &url, std::weak_ptr<Component::Task> tas
     });
 }
 
+Component::Task::ptr_t Component::makeDeleteTask(const string &taskName, const string &url,
+                                                  const string &collectionUrl, const selector_t &selector)
+{
+    return make_shared<Task>(*this, taskName, [this, url, collectionUrl, selector]
+                             (Task& task, const k8api::Event */*event*/) {
+        if (task.state() == Task::TaskState::READY) {
+            task.setState(Task::TaskState::EXECUTING);
+            if (collectionUrl.empty()) {
+                sendDelete(url, task.weak_from_this(), true);
+            } else {
+                sendDeleteAndWait(url, collectionUrl, selector, task.weak_from_this());
+            }
+        }
+
+        task.evaluate();
+    }, Task::TaskState::READY, Mode::REMOVE);
+}
+
+void Component::addCollectionRemovementTasks(Component::tasks_t &tasks)
+{
+    assert(isRoot());
+
+    const selector_t selector{"labelSelector", "k8dep-deployment="s + name};
+    std::set<string> collections;
+    std::vector<Component *> namespaces;
+    const auto first = tasks.size();
+
+    forAllComponents([&](Component& c) {
+        switch(c.kind_) {
+        case Kind::APP:
+        case Kind::HTTP_REQUEST:
+            break;
+        case Kind::NAMESPACE:
+            namespaces.push_back(&c);
+            break;
+        case Kind::SERVICE:
+            // Services don't support deletecollection before k8s 1.23
+            tasks.push_back(c.makeDeleteTask(c.name, c.getAccessUrl()));
+            break;
+        case Kind::STATEFULSET: {
+            // The claims from the volumeClaimTemplates don't have our labels
+            const auto url = c.cluster().getUrl() + "/api/v1/namespaces/" + c.getNamespace() + "/persistentvolumeclaims";
+            tasks.push_back(c.makeDeleteTask(c.name + "-delete-pvc", url, url, {"labelSelector", "app="s + c.name}));
+            collections.insert(c.getCreationUrl());
+            } break;
+        default:
+            collections.insert(c.getCreationUrl());
+        }
+
+        c.addCleanupTasks(tasks);
+    });
+
+    for(const auto& url : collections) {
+        tasks.push_back(makeDeleteTask("delete-" + url.substr(url.rfind('/') + 1), url, url, selector));
+    }
+
+    const auto last = tasks.size();
+    for(auto ns : namespaces) {
+        tasks.push_back(ns->makeDeleteTask(ns->name, ns->getAccessUrl()));
+        for(auto i = first; i < last; ++i) {
+            tasks.back()->addDependency(*tasks[i]);
+        }
+    }
+
+    LOG_DEBUG << logName() << "Deleting " << collections.size() << " collections with "
+              << (tasks.size() - first) << " tasks.";
+}
+
+bool Component::ownsItsNamespaces()
+{
+    std::set<string> owned;
+    forAllComponents([&owned](Component& c) {
+        if (c.kind_ == Kind::NAMESPACE) {
+            owned.insert(c.namespace_.metadata.name);
+        }
+    });
+
+    bool owns = !owned.empty();
+    forAllComponents([&](Component& c) {
+        if (!isClusterScoped(c.kind_) && c.kind_ != Kind::APP && c.kind_ != Kind::HTTP_REQUEST
+                && owned.find(c.getNamespace()) == owned.end()) {
+            LOG_TRACE << c.logName() << "Is in namespace " << c.getNamespace() << ", that we don't own.";
+            owns = false;
+        }
+    });
+
+    return owns;
+}
+
+void Component::addNamespaceRemovementTasks(Component::tasks_t &tasks)
+{
+    assert(isRoot());
+
+    const auto first = tasks.size();
+    forAllComponents([&](Component& c) {
+        if (c.kind_ == Kind::NAMESPACE) {
+            const auto& ns = c.namespace_.metadata.name;
+            tasks.push_back(c.makeDeleteTask(c.name, c.getAccessUrl(), c.getCreationUrl(),
+                                             {"fieldSelector", "metadata.name="s + ns}));
+        } else if (isClusterScoped(c.kind_)) {
+            tasks.push_back(c.makeDeleteTask(c.name, c.getAccessUrl()));
+        }
+
+        c.addCleanupTasks(tasks);
+    });
+
+    LOG_DEBUG << logName() << "Deleting the namespaces, with " << (tasks.size() - first) << " tasks.";
+}
+
+void Component::sendDeleteAndWait(const string &url, const string &collectionUrl,
+                                  const selector_t &selector, std::weak_ptr<Component::Task> task)
+{
+    cluster().governor().process([this, url, collectionUrl, selector, task](auto& ctx) {
+
+        LOG_DEBUG << logName() << "Sending DELETE " << url << " for " << selector.second;
+
+        try {
+            restc_cpp::RequestBuilder builder{ctx};
+            builder.Req(url, Request::Type::DELETE);
+            if (url == collectionUrl) {
+                builder.Argument(selector.first, selector.second);
+            }
+
+            auto reply = cluster().governor().execute(
+                        builder.Argument("propagationPolicy", "Background"));
+
+            LOG_DEBUG << logName()
+                  << "Delete gave response: "
+                  << reply->GetResponseCode() << ' '
+                  << reply->GetHttpResponse().reason_phrase;
+
+        } catch(const restc_cpp::RequestFailedWithErrorException& err) {
+            if (RequestGovernor::isThrottled(err)) {
+                throw; // Let the governor retry
+            }
+
+            if (err.http_response.status_code != 404) {
+                LOG_WARN << logName()
+                         << "Request failed: " << err.http_response.status_code
+                         << ' ' << err.http_response.reason_phrase
+                         << ": " << err.what();
+
+                // Like sendDelete(), we continue on errors
+                if (auto taskInstance = task.lock()) {
+                    taskInstance->setState(Task::TaskState::DONE);
+                }
+                return;
+            }
+        } catch(const std::exception& ex) {
+            LOG_WARN << logName()
+                     << "Request failed: " << ex.what();
+
+            if (auto taskInstance = task.lock()) {
+                taskInstance->setState(Task::TaskState::DONE);
+            }
+            return;
+        }
+
+        if (auto taskInstance = task.lock()) {
+            taskInstance->setState(Task::TaskState::WAITING);
+        }
+
+        waitForEmptyCollection(collectionUrl, selector, task, chrono::milliseconds{0});
+    });
+}
+
+template <typename T>
+void Component::watchUntilDeleted(const string &url, const selector_t &selector,
+                                  std::weak_ptr<Component::Task> task,
+                                  std::set<string> remaining, const string &resourceVersion)
+{
+    static unsigned serial = 0;
+
+    struct State {
+        std::set<string> remaining;
+        bool stopped = false;
+        bool released = false;
+    };
+
+    auto state = make_shared<State>();
+    state->remaining = move(remaining);
+    const auto key = "delete:" + url + '?' + selector.second + '#' + to_string(++serial);
+
+    auto watch = make_unique<Watch<T>>(cluster(), url,
+        typename Watch<T>::args_t{{selector.first, selector.second}},
+        [this, url, task, state](const WatchEvent<T>& event) {
+            const auto meta = getObjectMeta(event.object);
+            if (!meta) {
+                return;
+            }
+
+            if (event.type == "DELETED") {
+                state->remaining.erase(meta->name);
+            } else {
+                state->remaining.insert(meta->name);
+            }
+
+            if (state->remaining.empty()) {
+                state->stopped = true;
+                if (auto taskInstance = task.lock()) {
+                    taskInstance->setState(Task::TaskState::DONE);
+                }
+                return;
+            }
+
+            LOG_TRACE << logName() << "Still waiting for " << state->remaining.size()
+                      << " objects in " << url << " to be deleted.";
+        },
+        [this, url, selector, task, state] {
+            // We can't tell from the re-list when nothing is left. Start over with a new LIST.
+            state->stopped = true;
+            waitForEmptyCollection(url, selector, task, getPollConfig().initial);
+        },
+        [this, task, state, key] {
+            auto taskInstance = task.lock();
+            const auto active = !state->stopped && taskInstance
+                    && taskInstance->state() == Task::TaskState::WAITING
+                    && cluster().state() <= Cluster::State::EXECUTING;
+
+            // The watch returns without yielding when this is false, so it's
+            // gone when the posted handler runs.
+            if (!active && !state->released) {
+                state->released = true;
+                cluster().client().GetIoService().post([this, key] {
+                    cluster().watches().erase(key);
+                });
+            }
+            return active;
+        });
+
+    watch->setResourceVersion(resourceVersion);
+    watch->start();
+
+    // The cluster owns the watch until the wait is over, as it may outlive the task
+    cluster().watches()[key] = move(watch);
+}
+
+void Component::waitForEmptyCollection(const string &url, const selector_t &selector,
+                                       std::weak_ptr<Component::Task> task,
+                                       chrono::milliseconds delay)
+{
+    cluster().timers().schedule(delay, [this, url, selector, task, delay] {
+        if (task.expired()) {
+            return;
+        }
+
+        cluster().governor().process([this, url, selector, task, delay](auto& ctx) {
+            try {
+                // What is left, and where to start watching from
+                auto reply = cluster().governor().execute(restc_cpp::RequestBuilder{ctx}.Get(url)
+                        .Argument(selector.first, selector.second));
+
+                serialize_properties_t sp;
+                sp.name_mapping = jsonFieldMappings();
+                ObjectPage page;
+                SerializeFromJson(page, move(reply), sp);
+
+                if (page.items.empty()) {
+                    if (auto taskInstance = task.lock()) {
+                        taskInstance->setState(Task::TaskState::DONE);
+                    }
+                    return;
+                }
+
+                std::set<string> remaining;
+                for(const auto& item : page.items) {
+                    remaining.insert(item.metadata.name);
+                }
+
+                LOG_TRACE << logName() << "Waiting for " << remaining.size()
+                          << " objects in " << url << " to be deleted.";
+
+                if (kind_ == Kind::NAMESPACE) {
+                    watchUntilDeleted<k8api::Namespace>(url, selector, task, move(remaining),
+                                                        page.metadata.resourceVersion);
+                } else {
+                    watchUntilDeleted<AppliedObject>(url, selector, task, move(remaining),
+                                                     page.metadata.resourceVersion);
+                }
+                return;
+            } catch(const restc_cpp::RequestFailedWithErrorException& err) {
+                if (RequestGovernor::isThrottled(err)) {
+                    throw; // Let the governor retry
+                }
+
+                LOG_DEBUG << logName() << "Failed to list " << url << ": "
+                          << err.http_response.status_code << ' ' << err.http_response.reason_phrase;
+            } catch(const std::exception& ex) {
+                LOG_DEBUG << logName() << "Failed to list " << url << ": " << ex.what();
+            }
+
+            const auto pc = getPollConfig();
+            waitForEmptyCollection(url, selector, task, min(pc.max, max(pc.initial, chrono::milliseconds{
+                static_cast<int64_t>(delay.count() * pc.backoff)})));
+        });
+    });
+}
+
+void Component::addDeploymentLabels(k8api::ObjectMeta &meta) const
+{
+    for(const auto& [key, value] : labels) {
+        if (boost::starts_with(key, "k8dep-")) {
+            meta.labels.emplace(key, value);
+        }
+    }
+}
+
 void Component::calculateElapsed()
 {
     if (startTime) {
@@ -1785,26 +2483,17 @@ void Component::addDependency(Component &component)
         throw runtime_error("Cannot depend on myself!");
     }
 
-    std::set<Component *> deps;
-    component.addDependenciesRecursively(deps);
-    if (deps.find(this) != deps.end()) {
-        LOG_ERROR << logName() << "Detected circular dependency with: " << component.logName();
-        throw runtime_error("Circular dependency");
-    }
-
-    for(const auto& w : dependsOn_) {
-        if (const auto c = w.lock()) {
-            if (c.get() == &component) {
-                return;
-            }
-        }
+    // Circular dependencies are detected by checkForCircularDependencies()
+    if (find(dependsOn_.begin(), dependsOn_.end(), &component) != dependsOn_.end()) {
+        return;
     }
 
     LOG_DEBUG << logName() << "Component depends on " << component.logName();
-    dependsOn_.push_back(component.weak_from_this());
+    dependsOn_.push_back(&component);
+    component.dependents_.push_back(this);
 }
 
-void Component::prepareTasks(tasks_t& tasks, bool reverseDependencies)
+DependencyGraph Component::prepareTasks(tasks_t& tasks, bool reverseDependencies)
 {
 //    // Built list of tasks
 //    tasks_ = make_unique<tasks_t>();
@@ -1812,6 +2501,14 @@ void Component::prepareTasks(tasks_t& tasks, bool reverseDependencies)
 
     const bool isDelete = Engine::mode() == Engine::Mode::DELETE;
 
+    // Index the tasks by their component
+    for(auto& task : tasks) {
+        task->component().ownTasks_.clear();
+    }
+    for(auto& task : tasks) {
+        task->component().ownTasks_.push_back(task.get());
+    }
+
     // Set dependencies
     if (!isDelete) {
         for(auto& task : tasks) {
@@ -1828,22 +2525,18 @@ void Component::prepareTasks(tasks_t& tasks, bool reverseDependencies)
             case ParentRelation::AFTER:
                 // The task depend on parent task(s)
                 if (auto parent = task->component().parent_.lock()) {
-                    for(auto ptask : tasks) {
-                        if (&ptask->component() == parent.get()) {
-                            LOG_TRACE << task->component().logName() << "Task " << task->name() << " depends on " << ptask->name();
-                            task->addDependency(ptask->weak_from_this());
-                        }
+                    for(auto ptask : parent->ownTasks_) {
+                        LOG_TRACE << task->component().logName() << "Task " << task->name() << " depends on " << ptask->name();
+                        task->addDependency(*ptask);
                     }
                 }
                 break;
             case ParentRelation::BEFORE:
                 // The parent's tasks depend on the task(s)
                 if (auto parent = task->component().parent_.lock()) {
-                    for(auto ptask : tasks) {
-                        if (&ptask->component() == parent.get()) {
-                            LOG_TRACE << task->component().logName() << "Task " << ptask->name() << " depends on " << task->name();
-                            ptask->addDependency(task->weak_from_this());
-                        }
+                    for(auto ptask : parent->ownTasks_) {
+                        LOG_TRACE << task->component().logName() << "Task " << ptask->name() << " depends on " << task->name();
+                        ptask->addDependency(*task);
                     }
                 }
                 break;
@@ -1853,200 +2546,56 @@ void Component::prepareTasks(tasks_t& tasks, bool reverseDependencies)
         }
     }
 
-    // Check for circular dependencies
-    for (const auto& task : tasks) {
-        std::set<Task *> allDeps;
-        task->addAllDependencies(allDeps);
-        if (auto it = allDeps.find(task.get()) ; it != allDeps.end()) {
-            LOG_ERROR << task->component().logName() << "task " << task->name() << " Circular dependency to "
-            << (*it)->component().logName() << (*it)->name();
-            throw runtime_error("Circular dependency");
-        }
-    }
-}
-
-string getVar(const std::string& name, const variables_t& vars,
-              const optional<string>& defaultValue) {
-
-    if (auto [isClusterVar, clusterIx, vName] = Engine::parseClusterVar(name); isClusterVar) {
-        return Engine::instance().getClusterVar(clusterIx, vName);
+    // Flat index, with the edges from each dependency to the tasks depending on it
+    DependencyGraph::id_t id = 0;
+    for(auto& task : tasks) {
+        task->id_ = id++;
     }
 
-
-    if (auto it = vars.find(name); it != vars.end()) {
-        return it->second;
+    vector<DependencyGraph::edge_t> edges;
+    for(const auto& task : tasks) {
+        for(const auto dep : task->dependencies()) {
+            edges.emplace_back(dep->id(), task->id());
+        }
     }
 
-    if (auto val = getenv(name.c_str())) {
-        return val;
-    }
+    DependencyGraph graph{tasks.size(), edges};
 
-    if (defaultValue) {
-        return *defaultValue;
+    // Check for circular dependencies
+    if (const auto node = graph.findCycle()) {
+        auto& task = *tasks.at(*node);
+        LOG_ERROR << task.component().logName() << "task " << task.name() << " Circular dependency";
+        throw runtime_error("Circular dependency");
     }
 
-    return {};
+    return graph;
 }
 
-string expandVariables(const string &json, const variables_t &vars)
+void Component::checkForCircularDependencies()
 {
-    // Var: ${varname[,default value]}
-    // Default is unset/null
-
-    enum class State {
-        COPY,
-        BACKSLASH,
-        DOLLAR,
-        SCAN_NAME,
-        SCAN_DEFAUT_VALUE,
-        SCAN_FUNCTION_NAME,
-        SCAN_FUNCTION_ARG
-    };
-
-    locale loc{"C"};
-    string expanded;
-    expanded.reserve(json.size());
-    auto state = State::COPY;
-    string varName;
-    string functionName;
-    string functionArg;
-    int pharantheses = 0;
-    int braces = 0;
-    optional<string> defaultValue;
-    for(auto ch : json) {
-again:
-        switch(state) {
-        case State::COPY:
-            if (ch == '\\') {
-                state = State::BACKSLASH;
-                break;
-            }
-            if (ch == '$') {
-                state = State::DOLLAR;
-                break;
-            }
-            expanded += ch;
-            break;
-        case State::BACKSLASH:
-            if (ch != '$') {
-                expanded += '\\';
-            }
-            expanded += ch;
-            state = State::COPY;
-            break;
-        case State::DOLLAR:
-            if (ch == '{') {
-                state = State::SCAN_NAME;
-                varName.clear();
-                defaultValue.reset();
-                break;
-            }
-            if (isalnum(ch, loc)) {
-                state = State::SCAN_FUNCTION_NAME;
-                functionName.clear();
-                functionArg.clear();
-                functionName += ch;
-                break;
-            }
-            expanded += '$';
-            expanded += ch;
-            state = State::COPY;
-            break;
-        case State::SCAN_NAME:
-            if (isalnum(ch, loc) || ch == '.' || ch == '_' || ch == ':') {
-                varName += ch;
-                break;
-            }
-            if (ch == ',') {
-                defaultValue.emplace();
-                state = State::SCAN_DEFAUT_VALUE;
-                braces = 1;
-                break;
-            }
-commit:
-            if (ch == '}') {
-                // Commint variable
-                if (defaultValue &&
-                    defaultValue->size() > 1 &&
-                    defaultValue->at(0) == '$' &&
-                    defaultValue->at(1) != '(') {
-                      if (const auto evar = getenv(defaultValue->substr(1).c_str())) {
-                          *defaultValue = *evar;
-                    }
-                }
-
-                expanded += getVar(varName, vars, defaultValue);
-                state = State::COPY;
-                break;
-            }
-
-            LOG_ERROR << "Error scanning variable-name starting with: " << varName;
-            throw runtime_error("Error expanding macro");
-
-        case State::SCAN_DEFAUT_VALUE:
-            // We may encounter recursive variables and functions here
-            if (ch == '{') {
-                ++braces;
-            }
-            if (ch == '}') {
-                if (--braces == 0) {
-                    if (defaultValue) {
-                        defaultValue = expandVariables(*defaultValue, vars);
-                    }
-                    goto commit;
-                }
-            }
-
-            if (ch == '"') {
-                *defaultValue  += '\\';
-            }
-            *defaultValue += ch;
-            break;
+    vector<Component *> components;
+    unordered_map<const Component *, DependencyGraph::id_t> ids;
+    forAllComponents([&](Component& c) {
+        ids[&c] = static_cast<DependencyGraph::id_t>(components.size());
+        components.push_back(&c);
+    });
 
-        case State::SCAN_FUNCTION_NAME:
-            if (isalnum(ch, loc)) {
-                functionName += ch;
-                break;
-            }
-            if (ch == '(') {
-                pharantheses = 1;
-                state = State::SCAN_FUNCTION_ARG;
-                break;
-            }
-            // It's not a function!
-            // Treat the input as plain text and give it back
-            expanded += '$';
-            expanded += functionName;
-            state = State::COPY;
-            goto again; // This will parse `ch` using COPY state
-
-        case State::SCAN_FUNCTION_ARG:
-            if (ch == '(') {
-                ++pharantheses;
-            } else if (ch == ')') {
-               if (--pharantheses == 0) {
-                   auto expanded_args = expandVariables(functionArg, vars);
-                   auto txt = execFunction(functionName, expanded_args);
-                   expanded += txt;
-                   state = State::COPY;
-                   break;
-               }
-            }
-            functionArg += ch;
-            break;
+    vector<DependencyGraph::edge_t> edges;
+    for(const auto c : components) {
+        for(const auto dep : c->dependsOn_) {
+            edges.emplace_back(ids.at(dep), ids.at(c));
         }
     }
 
-    if (state != State::COPY) {
-        if (state == State::SCAN_FUNCTION_NAME || state == State::SCAN_FUNCTION_ARG) {
-            LOG_ERROR << "Error expanding function macro " << functionName << ": Not properly terminated with '(...)'";
-        } else {
-            LOG_ERROR << "Error expanding macro " << varName << ": Not properly terminated with '}'";
-        }
-        throw runtime_error("Error expanding macro");
+    if (const auto node = DependencyGraph{components.size(), edges}.findCycle()) {
+        LOG_ERROR << components.at(*node)->logName() << "Detected circular dependency";
+        throw runtime_error("Circular dependency");
     }
+}
 
-    return expanded;
+string expandVariables(const string &json, const variables_t &vars)
+{
+    return MacroTemplate{json}.expand(vars);
 }
 
 namespace {
@@ -96,58 +96,15 @@ void ConfigMapComponent::addRemovementTasks(Component::tasks_t &tasks)
 
 void ConfigMapComponent::doDeploy(std::weak_ptr<Component::Task> task)
 {
-    auto url = cluster_->getUrl()
+    sendApply(configmap, getCreationUrl(), task);
+}
+
+string ConfigMapComponent::getCreationUrl() const
+{
+    return cluster_->getUrl()
             + "/api/v1/namespaces/"
             + getNamespace()
             + "/configmaps";
-
-    client().Process([this, url, task](Context& ctx) {
-
-        LOG_DEBUG << logName()
-                  << "Sending ConfigMap "
-                  << configmap.metadata.name;
-
-        LOG_TRACE << "Payload: " << toJson(configmap);
-
-        try {
-            auto reply = RequestBuilder{ctx}.Post(url)
-               .Data(configmap, jsonFieldMappings())
-               .Execute();
-
-            LOG_DEBUG << logName()
-                  << "Applying gave response: "
-                  << reply->GetResponseCode() << ' '
-                  << reply->GetHttpResponse().reason_phrase;
-
-            // We don't get any event's related to the service, so just update the states.
-            if (auto taskInstance = task.lock()) {
-                taskInstance->setState(Task::TaskState::DONE);
-            }
-
-            if (state_ == State::RUNNING) {
-                setIsDone();
-            }
-
-            return;
-        } catch(const RequestFailedWithErrorException& err) {
-            LOG_WARN << logName()
-                     << "Request failed: " << err.http_response.status_code
-                     << ' ' << err.http_response.reason_phrase
-                     << ": " << err.what();
-        } catch(const std::exception& ex) {
-            LOG_WARN << logName()
-                     << "Request failed: " << ex.what();
-        }
-
-        if (auto taskInstance = task.lock()) {
-            taskInstance->setState(Task::TaskState::FAILED);
-        }
-
-        if (state_ == State::RUNNING) {
-            setState(State::FAILED);
-        }
-
-    });
 }
 
 void ConfigMapComponent::doRemove(std::weak_ptr<Component::Task> task)
@@ -157,15 +114,14 @@ void ConfigMapComponent::doRemove(std::weak_ptr<Component::Task> task)
             + getNamespace()
             + "/configmaps/" + name;
 
-    client().Process([this, url, task](Context& ctx) {
+    cluster().governor().process([this, url, task](Context& ctx) {
 
         LOG_DEBUG << logName()
                   << "Deleting ConfigMap "
                   << name;
 
         try {
-            auto reply = RequestBuilder{ctx}.Delete(url)
-               .Execute();
+            auto reply = cluster().governor().execute(RequestBuilder{ctx}.Delete(url));
 
             LOG_DEBUG << logName()
                   << "Deleting gave response: "
@@ -183,6 +139,10 @@ void ConfigMapComponent::doRemove(std::weak_ptr<Component::Task> task)
 
             return;
         } catch(const RequestFailedWithErrorException& err) {
+            if (RequestGovernor::isThrottled(err)) {
+                throw; // Let the governor retry
+            }
+
             if (err.http_response.status_code == 404) {
                 // Perfectly OK
                 if (auto taskInstance = task.lock()) {
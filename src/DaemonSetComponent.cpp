@@ -12,6 +12,33 @@ using namespace restc_cpp;
 
 namespace k8deployer {
 
+namespace {
+
+// Ready when the controller has seen the current generation, and the new
+// pods are available on all the nodes.
+bool isRolledOut(const k8api::DaemonSet& data, int appliedGeneration)
+{
+    if (!data.status) {
+        return false;
+    }
+
+    const auto& status = *data.status;
+
+    LOG_TRACE << "Probe verify: generation = " << data.metadata.generation
+              << ", observedGeneration = " << status.observedGeneration
+              << ", desiredNumberScheduled = " << status.desiredNumberScheduled
+              << ", updatedNumberScheduled = " << status.updatedNumberScheduled
+              << ", numberAvailable = " << status.numberAvailable;
+
+    return data.metadata.generation >= appliedGeneration
+            && static_cast<int64_t>(status.observedGeneration) >= data.metadata.generation
+            && status.desiredNumberScheduled > 0
+            && status.updatedNumberScheduled >= status.desiredNumberScheduled
+            && status.numberAvailable >= status.desiredNumberScheduled;
+}
+
+} // anon ns
+
 void DaemonSetComponent::prepareDeploy()
 {
     if (!daemonset.spec) {
@@ -72,11 +99,11 @@ bool DaemonSetComponent::probe(std::function<void (Component::K8ObjectState)> fn
                 assert(fn);
                 fn(state);
             }
-            }, [](const auto& data) {
+            }, [this](const auto& data) {
                 if (Engine::mode() == Engine::Mode::DELETE) {
                     return false; // Done when deleted
                 }
-                return data.status->numberReady > 0;
+                return isRolledOut(data, appliedGeneration());
             }
         );
     }
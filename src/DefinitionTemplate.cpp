@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <filesystem>
+#include <sstream>
+
+#include "restc-cpp/SerializeJson.h"
+
+#include "k8deployer/DefinitionTemplate.h"
+#include "k8deployer/Component.h"
+#include "k8deployer/logging.h"
+#include "k8deployer/yaml_fn.h"
+
+namespace k8deployer {
+namespace {
+
+struct CachedSlot {
+    std::string value;
+    bool plain = false;
+    bool isKey = false;
+};
+
+// No literals if the yaml was not parsed into a template
+struct CachedDefinition {
+    std::vector<std::string> literals;
+    std::vector<CachedSlot> slots;
+};
+
+} // anon ns
+} // ns
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::CachedSlot,
+    (std::string, value)
+    (bool, plain)
+    (bool, isKey)
+);
+
+BOOST_FUSION_ADAPT_STRUCT(k8deployer::CachedDefinition,
+    (std::vector<std::string>, literals)
+    (std::vector<k8deployer::CachedSlot>, slots)
+);
+
+using namespace std;
+
+namespace k8deployer {
+
+DefinitionTemplate::DefinitionTemplate(string path, const FileCache *cache)
+    : path_{move(path)}, cache_{cache}
+{
+    if (!filesystem::is_regular_file(path_)) {
+        LOG_ERROR << "Not a file: " << path_;
+        throw runtime_error("Not a file: "s + path_);
+    }
+
+    // Anything that is not .json is read as yaml, including .yml and no extension
+    isYaml_ = filesystem::path{path_}.extension() != ".json";
+    raw_ = slurp(path_);
+
+    if (isYaml_) {
+        const auto key = cache_ ? FileCache::key<CachedDefinition>("definition-template", raw_) : string{};
+        if (!cache_ || !loadParsed(key)) {
+            parse();
+            if (cache_) {
+                storeParsed(key);
+            }
+        }
+    }
+
+    if (!isParsed()) {
+        rawMacros_ = MacroTemplate{raw_};
+    }
+}
+
+unique_ptr<ComponentDataDef> DefinitionTemplate::instantiate(const variables_t &vars) const
+{
+    auto expanded = expand(vars);
+
+    {
+        lock_guard<mutex> lock{mutex_};
+        if (auto it = instances_.find(expanded); it != instances_.end()) {
+            LOG_TRACE << "Re-using the definition from " << path_;
+            return make_unique<ComponentDataDef>(*it->second);
+        }
+    }
+
+    auto def = make_shared<ComponentDataDef>();
+    const auto key = cache_
+            ? FileCache::key<ComponentDataDef>(isYaml_ && !isParsed() ? "definition-yaml" : "definition", expanded)
+            : string{};
+    if (!cache_ || !cache_->load(key, *def)) {
+        istringstream ifs{toJson(expanded)};
+        restc_cpp::SerializeFromJson(*def, ifs);
+
+        if (cache_) {
+            cache_->store(key, *def);
+        }
+    }
+
+    lock_guard<mutex> lock{mutex_};
+    instances_.emplace(move(expanded), def);
+    return make_unique<ComponentDataDef>(*def);
+}
+
+void DefinitionTemplate::parse()
+{
+    vector<string> literals;
+    vector<Slot> slots;
+    size_t macroChars = 0;
+
+    string json;
+    try {
+        json = yamlToJson(raw_, path_, [&](string& out, const string& value, bool plain, bool isKey) {
+            const auto cnt = static_cast<size_t>(count(value.begin(), value.end(), '$'));
+            if (!cnt) {
+                return false;
+            }
+
+            macroChars += cnt;
+            literals.emplace_back(move(out));
+            out.clear();
+            slots.push_back({value, MacroTemplate{value}, plain, isKey});
+            return true;
+        });
+    } catch(const exception& ex) {
+        LOG_DEBUG << "The raw definition in " << path_
+                  << " is not valid yaml. The macros will be expanded for each cluster.";
+        return;
+    }
+
+    // If some `$` are not in the scalars, we can't tell how the macros are expanded.
+    if (macroChars != static_cast<size_t>(count(raw_.begin(), raw_.end(), '$'))) {
+        LOG_DEBUG << "Some macros in " << path_
+                  << " are not inside yaml values. They will be expanded for each cluster.";
+        return;
+    }
+
+    literals.emplace_back(move(json));
+    literals_ = move(literals);
+    slots_ = move(slots);
+
+    LOG_DEBUG << "Parsed the definition in " << path_ << " with " << slots_.size() << " macro values.";
+}
+
+bool DefinitionTemplate::loadParsed(const string &key)
+{
+    CachedDefinition cached;
+    if (!cache_->load(key, cached)) {
+        return false;
+    }
+
+    if (!cached.literals.empty() && cached.literals.size() != cached.slots.size() + 1) {
+        LOG_WARN << "Ignoring invalid cache entry " << key;
+        return false;
+    }
+
+    literals_ = move(cached.literals);
+    slots_.clear();
+    slots_.reserve(cached.slots.size());
+    for(auto& slot : cached.slots) {
+        MacroTemplate macros{slot.value};
+        slots_.push_back({move(slot.value), move(macros), slot.plain, slot.isKey});
+    }
+
+    LOG_DEBUG << "Using the parsed definition for " << path_ << " from the cache.";
+    return true;
+}
+
+void DefinitionTemplate::storeParsed(const string &key) const
+{
+    CachedDefinition cached;
+    cached.literals = literals_;
+    cached.slots.reserve(slots_.size());
+    for(const auto& slot : slots_) {
+        cached.slots.push_back({slot.value, slot.plain, slot.isKey});
+    }
+
+    cache_->store(key, cached);
+}
+
+string DefinitionTemplate::expand(const variables_t &vars) const
+{
+    if (!isParsed()) {
+        return rawMacros_.expand(vars);
+    }
+
+    string json;
+    for(size_t i = 0; i < slots_.size(); ++i) {
+        json += literals_[i];
+        appendSlot(json, slots_[i], vars);
+    }
+    json += literals_.back();
+
+    return json;
+}
+
+string DefinitionTemplate::toJson(const string &expanded) const
+{
+    return isYaml_ && !isParsed() ? yamlToJson(expanded, path_) : expanded;
+}
+
+void DefinitionTemplate::appendSlot(string &out, const DefinitionTemplate::Slot &slot,
+                                    const variables_t &vars) const
+{
+    const auto value = slot.macros.expand(vars);
+
+    // A plain value may expand to something that is not a scalar,
+    // like `[a, b]` or a quoted string. Then it's parsed as yaml.
+    if (slot.plain && !slot.isKey && !value.empty()
+            && (value.front() == '[' || value.front() == '{'
+                || value.front() == '"' || value.front() == '\''
+                || value.find('\n') != string::npos)) {
+        out += yamlToJson(value, path_);
+        return;
+    }
+
+    appendYamlScalar(out, value, slot.plain, slot.isKey);
+}
+
+} // ns
@@ -0,0 +1,94 @@
+#include <cassert>
+
+#include "k8deployer/DependencyGraph.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+DependencyGraph::DependencyGraph(size_t nodes, const vector<DependencyGraph::edge_t> &edges)
+    : offsets_(nodes + 1), targets_(edges.size())
+{
+    // Counting sort on the source node
+    for(const auto& [from, to] : edges) {
+        assert(from < nodes && to < nodes);
+        ++offsets_[from + 1];
+    }
+
+    for(size_t i = 1; i < offsets_.size(); ++i) {
+        offsets_[i] += offsets_[i - 1];
+    }
+
+    auto next = offsets_;
+    for(const auto& [from, to] : edges) {
+        targets_[next[from]++] = to;
+    }
+}
+
+vector<DependencyGraph::id_t> DependencyGraph::sortTopologically() const
+{
+    vector<id_t> incoming(size());
+    for(const auto to : targets_) {
+        ++incoming[to];
+    }
+
+    vector<id_t> order;
+    order.reserve(size());
+    for(id_t node = 0; node < size(); ++node) {
+        if (!incoming[node]) {
+            order.push_back(node);
+        }
+    }
+
+    // order is also the queue
+    for(size_t i = 0; i < order.size(); ++i) {
+        for(const auto to : edges(order[i])) {
+            if (--incoming[to] == 0) {
+                order.push_back(to);
+            }
+        }
+    }
+
+    return order;
+}
+
+optional<DependencyGraph::id_t> DependencyGraph::findCycle() const
+{
+    const auto order = sortTopologically();
+    if (order.size() == size()) {
+        return {};
+    }
+
+    vector<bool> sorted(size());
+    for(const auto node : order) {
+        sorted[node] = true;
+    }
+
+    // All the nodes that was left out have an edge from another one
+    // that was left out. Walk these edges backwards until we are back
+    // to a node we have seen. That node is on a cycle.
+    vector<id_t> from(size());
+    optional<id_t> start;
+    for(id_t node = 0; node < size(); ++node) {
+        if (!sorted[node]) {
+            start = node;
+            for(const auto to : edges(node)) {
+                if (!sorted[to]) {
+                    from[to] = node;
+                }
+            }
+        }
+    }
+
+    assert(start);
+    vector<bool> seen(size());
+    auto node = *start;
+    while(!seen[node]) {
+        seen[node] = true;
+        node = from[node];
+    }
+
+    return node;
+}
+
+} // ns
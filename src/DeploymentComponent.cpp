@@ -13,6 +13,34 @@ using namespace restc_cpp;
 
 namespace k8deployer {
 
+namespace {
+
+// Same rules as `kubectl rollout status`. The `Available` condition is
+// true during a rolling update, as long as enough old pods are running.
+bool isRolledOut(const k8api::Deployment& data, int appliedGeneration)
+{
+    if (!data.status) {
+        return false;
+    }
+
+    const auto& status = *data.status;
+    const size_t replicas = data.spec.replicas ? *data.spec.replicas : 1;
+
+    LOG_TRACE << "Probe verify: generation = " << data.metadata.generation
+              << ", observedGeneration = " << status.observedGeneration
+              << ", replicas = " << replicas
+              << ", updatedReplicas = " << status.updatedReplicas
+              << ", availableReplicas = " << status.availableReplicas;
+
+    return data.metadata.generation >= appliedGeneration
+            && static_cast<int64_t>(status.observedGeneration) >= data.metadata.generation
+            && status.updatedReplicas >= replicas
+            && status.replicas <= status.updatedReplicas // No old pods left
+            && status.availableReplicas >= status.updatedReplicas;
+}
+
+} // anon ns
+
 void DeploymentComponent::prepareDeploy()
 {
     if (auto replicas = getArg("replicas")) {
@@ -269,13 +297,9 @@ bool DeploymentComponent::probe(std::function<void (Component::K8ObjectState)> f
                     assert(fn);
                     fn(state);
                 }
-            }, [](const auto& data) {
-            if (Engine::mode() == Engine::Mode::DEPLOY) {
-                    for(const auto& cond : data.status->conditions) {
-                        if (cond.type == "Available" && cond.status == "True") {
-                            return true;
-                        }
-                    }
+            }, [this](const auto& data) {
+                if (Engine::isApplying()) {
+                    return isRolledOut(data, appliedGeneration());
                 }
 
                 return false;
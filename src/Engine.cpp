@@ -1,4 +1,5 @@
 #include <filesystem>
+#include <fstream>
 
 #include <boost/fusion/adapted.hpp>
 #include <boost/process.hpp>
@@ -9,6 +10,7 @@
 #include "k8deployer/logging.h"
 #include "k8deployer/Engine.h"
 #include "k8deployer/Component.h"
+#include "k8deployer/Simulator.h"
 
 using namespace std;
 using namespace chrono_literals;
@@ -30,11 +32,25 @@ Engine::Engine(const Config &config)
         mode_ = Mode::DELETE;
     } else if (cfg_.command == "depends") {
         mode_ = Mode::SHOW_DEPENDENCIES;
+    } else if (cfg_.command == "simulate") {
+        mode_ = Mode::SIMULATE;
+    } else if (cfg_.command == "update") {
+        mode_ = Mode::UPDATE;
     } else {
         LOG_ERROR << "Unknown command: " << cfg_.command ;
         throw runtime_error("Unknown command "s + cfg_.command);
     }
 
+    if (cfg_.deleteMode != "auto" && cfg_.deleteMode != "objects"
+            && cfg_.deleteMode != "collection" && cfg_.deleteMode != "namespace") {
+        LOG_ERROR << "Unknown delete-mode: " << cfg_.deleteMode;
+        throw runtime_error("Unknown delete-mode "s + cfg_.deleteMode);
+    }
+
+    if (!cfg_.cacheDir.empty()) {
+        cache_ = make_unique<FileCache>(cfg_.cacheDir);
+    }
+
     assert(instance_ == nullptr);
     instance_ = this;
 }
@@ -53,6 +69,14 @@ void Engine::run()
         }
     }
 
+    // Read once. Each cluster instantiates it with it's own variables.
+    definition_ = make_unique<DefinitionTemplate>(cfg_.definitionFile, cache());
+
+    // The clusters may use each others variables when they are prepared
+    for(auto& cluster : clusters_) {
+        cluster->init();
+    }
+
     std::deque<future<void>> futures;
 
     for(auto& cluster : clusters_) {
@@ -96,6 +120,10 @@ void Engine::run()
         f.get();
     }
 
+    if (isApplying() && !cfg_.saveTimings.empty()) {
+        saveTimings();
+    }
+
     LOG_INFO << "Done. Shutting down background threads and async IO.";
     for(auto& cluster : clusters_) {
         try {
@@ -144,8 +172,8 @@ std::tuple<bool, size_t, string> Engine::parseClusterVar(const string &name)
 
 string Engine::getClusterVar(size_t clusterIx, const string &varName)
 {
+    // The variables are read-only after Cluster::init()
     if (auto c = getCluster(clusterIx)) {
-        c->getVarsReadyStage().wait();
         if (auto v = c->getVar(varName)) {
             return *v;
         }
@@ -155,6 +183,22 @@ string Engine::getClusterVar(size_t clusterIx, const string &varName)
     throw runtime_error{"No such cluster or var: "};
 }
 
+void Engine::saveTimings()
+{
+    ofstream out{cfg_.saveTimings};
+    if (!out.is_open()) {
+        LOG_WARN << "Failed to open " << cfg_.saveTimings << " for writing.";
+        return;
+    }
+
+    LOG_INFO << "Saving the tasks elapsed times to: " << cfg_.saveTimings;
+    for(auto& cluster : clusters_) {
+        if (auto root = cluster->getRootComponent()) {
+            Simulator::saveTimings(*root, out);
+        }
+    }
+}
+
 void Engine::startPortForwardig()
 {
 //    for(auto& cluster : clusters_) {
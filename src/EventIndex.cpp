@@ -0,0 +1,77 @@
+#include <algorithm>
+
+#include "k8deployer/EventIndex.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+void EventIndex::add(const string &kind, const string &ns, const string &name,
+                     const Component::Task::wptr_t& task)
+{
+    exact_[key(kind, ns, name)].push_back(task);
+}
+
+void EventIndex::addPrefix(const string &kind, const string &ns, const string &prefix,
+                           const Component::Task::wptr_t& task)
+{
+    if (prefix.empty() || prefix.back() != '-') {
+        throw runtime_error("Event prefixes must end with '-': "s + prefix);
+    }
+
+    prefixes_[key(kind, ns, prefix)].push_back(task);
+}
+
+EventIndex::tasks_t EventIndex::lookup(const k8api::Event &event) const
+{
+    tasks_t tasks;
+    const auto& obj = event.involvedObject;
+
+    auto k = key(obj.kind, obj.namespace_, obj.name);
+    if (auto it = exact_.find(k); it != exact_.end()) {
+        append(tasks, it->second);
+    }
+
+    if (!prefixes_.empty()) {
+        // The name starts at the end of the key
+        const auto nameStart = k.size() - obj.name.size();
+        for(auto pos = k.find('-', nameStart); pos != string::npos; pos = k.find('-', pos + 1)) {
+            if (auto it = prefixes_.find(k.substr(0, pos + 1)); it != prefixes_.end()) {
+                append(tasks, it->second);
+            }
+        }
+    }
+
+    return tasks;
+}
+
+string EventIndex::key(const string &kind, const string &ns, const string &name)
+{
+    string k;
+    k.reserve(kind.size() + ns.size() + name.size() + 2);
+    k += kind;
+    k += '/';
+    k += ns;
+    k += '/';
+    k += name;
+    return k;
+}
+
+void EventIndex::append(EventIndex::tasks_t &tasks, const EventIndex::tasks_t &add)
+{
+    for(const auto& w : add) {
+        const auto task = w.lock();
+        if (!task) {
+            continue;
+        }
+
+        if (find_if(tasks.begin(), tasks.end(), [&task](const auto& t) {
+                return t.lock() == task;
+            }) == tasks.end()) {
+            tasks.push_back(w);
+        }
+    }
+}
+
+} // ns
@@ -0,0 +1,203 @@
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+
+#include "k8deployer/FileCache.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+namespace {
+
+// Magic and format version at the start of each entry
+constexpr string_view header{"k8dc\x01\0\0\0", 8};
+
+struct Fd {
+    explicit Fd(int fd) : fd{fd} {}
+    ~Fd() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    int fd;
+};
+
+struct Mapping {
+    Mapping(void *addr, size_t len) : addr{addr}, len{len} {}
+    ~Mapping() {
+        if (addr != MAP_FAILED) {
+            munmap(addr, len);
+        }
+    }
+
+    void *addr;
+    size_t len;
+};
+
+bool writeAll(int fd, string_view data)
+{
+    while(!data.empty()) {
+        const auto bytes = ::write(fd, data.data(), data.size());
+        if (bytes < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data.remove_prefix(static_cast<size_t>(bytes));
+    }
+
+    return true;
+}
+
+} // anon ns
+
+FileCache::FileCache(filesystem::path dir)
+    : dir_{move(dir)}
+{
+    if (!filesystem::is_directory(dir_)) {
+        filesystem::create_directories(dir_);
+        filesystem::permissions(dir_, filesystem::perms::owner_all);
+    }
+
+    // Others could read the credentials, or plant entries
+    struct stat st = {};
+    if (stat(dir_.c_str(), &st) != 0) {
+        LOG_ERROR << "Failed to stat " << dir_ << ": " << strerror(errno);
+        throw runtime_error("Failed to use the cache in "s + dir_.string());
+    }
+
+    if (st.st_uid != geteuid()) {
+        LOG_ERROR << "The cache directory " << dir_ << " is owned by another user.";
+        throw runtime_error("Unsafe cache directory "s + dir_.string());
+    }
+
+    if ((st.st_mode & (S_IRWXG | S_IRWXO)) != 0) {
+        LOG_WARN << "The cache directory " << dir_ << " is accessible by others. Restricting it to the owner.";
+        filesystem::permissions(dir_, filesystem::perms::owner_all);
+    }
+
+    LOG_DEBUG << "Using the cache in " << dir_;
+}
+
+string FileCache::key(string_view kind, string_view layout, string_view content)
+{
+    static const string version{"k8deployer " K8DEPLOYER_VERSION};
+
+    unsigned char md[EVP_MAX_MD_SIZE] = {};
+    unsigned int mdLen = 0;
+
+    unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx{EVP_MD_CTX_new(), EVP_MD_CTX_free};
+    if (!ctx
+            || !EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr)
+            || !EVP_DigestUpdate(ctx.get(), version.c_str(), version.size() + 1)
+            || !EVP_DigestUpdate(ctx.get(), kind.data(), kind.size())
+            || !EVP_DigestUpdate(ctx.get(), "", 1)
+            || !EVP_DigestUpdate(ctx.get(), layout.data(), layout.size())
+            || !EVP_DigestUpdate(ctx.get(), "", 1)
+            || !EVP_DigestUpdate(ctx.get(), content.data(), content.size())
+            || !EVP_DigestFinal_ex(ctx.get(), md, &mdLen)) {
+        throw runtime_error("Failed to calculate sha256");
+    }
+
+    static constexpr char hex[] = "0123456789abcdef";
+    string key{kind};
+    key += '-';
+    for(unsigned int i = 0; i < mdLen; ++i) {
+        key += hex[md[i] >> 4];
+        key += hex[md[i] & 0x0f];
+    }
+
+    return key;
+}
+
+bool FileCache::read(const string &key, const function<void (string_view)> &fn) const
+{
+    const auto path = pathOf(key);
+    Fd file{open(path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (file.fd < 0) {
+        if (errno != ENOENT) {
+            LOG_WARN << "Failed to open " << path << ": " << strerror(errno);
+        }
+        return false;
+    }
+
+    struct stat st = {};
+    if (fstat(file.fd, &st) != 0 || static_cast<size_t>(st.st_size) < header.size()) {
+        LOG_WARN << "Ignoring invalid cache entry " << path;
+        return false;
+    }
+
+    const auto len = static_cast<size_t>(st.st_size);
+    Mapping mapping{mmap(nullptr, len, PROT_READ, MAP_PRIVATE, file.fd, 0), len};
+    if (mapping.addr == MAP_FAILED) {
+        LOG_WARN << "Failed to map " << path << ": " << strerror(errno);
+        return false;
+    }
+
+    string_view data{static_cast<const char *>(mapping.addr), len};
+    if (data.substr(0, header.size()) != header) {
+        LOG_WARN << "Ignoring invalid cache entry " << path;
+        return false;
+    }
+    data.remove_prefix(header.size());
+
+    try {
+        fn(data);
+    } catch(const exception& ex) {
+        LOG_WARN << "Ignoring invalid cache entry " << path << ": " << ex.what();
+        return false;
+    }
+
+    LOG_TRACE << "Cache hit: " << key;
+    return true;
+}
+
+void FileCache::write(const string &key, const string &data) const
+{
+    static atomic_uint serial{0};
+
+    const auto path = pathOf(key);
+    auto tmp = path;
+    tmp += ".tmp." + to_string(getpid()) + '.' + to_string(++serial);
+
+    {
+        Fd file{open(tmp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600)};
+        if (file.fd < 0) {
+            LOG_WARN << "Failed to create " << tmp << ": " << strerror(errno);
+            return;
+        }
+
+        if (!writeAll(file.fd, header) || !writeAll(file.fd, data)) {
+            LOG_WARN << "Failed to write " << tmp << ": " << strerror(errno);
+            unlink(tmp.c_str());
+            return;
+        }
+    }
+
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG_WARN << "Failed to rename " << tmp << ": " << strerror(errno);
+        unlink(tmp.c_str());
+        return;
+    }
+
+    LOG_TRACE << "Cached: " << key;
+}
+
+filesystem::path FileCache::pathOf(const string &key) const
+{
+    return dir_ / (key + ".bin");
+}
+
+} // ns
@@ -255,7 +255,7 @@ void IngressComponent::addDeploymentTasks(Component::tasks_t &tasks)
             task.evaluate();
         });
 
-        dnsTask->addDependency(task);
+        dnsTask->addDependency(*task);
         tasks.push_back(dnsTask);
     }
 
@@ -277,7 +277,12 @@ void IngressComponent::addRemovementTasks(Component::tasks_t &tasks)
     }, Task::TaskState::READY);
 
     tasks.push_back(task);
+    addCleanupTasks(tasks);
+    Component::addRemovementTasks(tasks);
+}
 
+void IngressComponent::addCleanupTasks(Component::tasks_t &tasks)
+{
     if (cluster_->getDns()) {
         auto dnsTask = make_shared<Task>(*this, name + "-provision-dns",
                                          [&](Task& task, const k8api::Event */*event*/) {
@@ -309,9 +314,6 @@ void IngressComponent::addRemovementTasks(Component::tasks_t &tasks)
 
         tasks.push_back(dnsTask);
     }
-
-
-    Component::addRemovementTasks(tasks);
 }
 
 void IngressComponent::doDeploy(std::weak_ptr<Component::Task> task)
@@ -40,7 +40,7 @@ bool JobComponent::probe(std::function<void (Component::K8ObjectState)> fn)
                     fn(state);
                 }
             }, [] (const auto& data) {
-                if (Engine::mode() == Engine::Mode::DEPLOY) {
+                if (Engine::isApplying()) {
                     for(const auto& cond : data.status->conditions) {
                         if (cond.type == "Complete" && cond.status == "True") {
                             return true;
@@ -93,11 +93,15 @@ void JobComponent::addRemovementTasks(Component::tasks_t &tasks)
 
 void JobComponent::doDeploy(std::weak_ptr<Task> task)
 {
-    const auto url = cluster_->getUrl()
+    sendApply(job, getCreationUrl(), task);
+}
+
+string JobComponent::getCreationUrl() const
+{
+    return cluster_->getUrl()
             + "/apis/batch/v1/namespaces/"s
-            + job.metadata.namespace_
+            + getNamespace()
             + "/jobs";
-    sendApply(job, url, task);
 }
 
 void JobComponent::doRemove(std::weak_ptr<Component::Task> task)
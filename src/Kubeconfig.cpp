@@ -1,5 +1,7 @@
 #include "k8deployer/Kubeconfig.h"
 #include "k8deployer/Component.h"
+#include "k8deployer/FileCache.h"
+#include "k8deployer/yaml_fn.h"
 
 #include <boost/fusion/adapted.hpp>
 
@@ -113,7 +115,7 @@ string Kubeconfig::getClusterName() const
     return clusters.at(activeCluster).name;
 }
 
-unique_ptr<Kubeconfig> Kubeconfig::load(const string &kubefile)
+unique_ptr<Kubeconfig> Kubeconfig::load(const string &kubefile, const FileCache *cache)
 {
     static const restc_cpp::JsonFieldMapping mappings = {
         {"certificate_authority_data", "certificate-authority-data"},
@@ -127,16 +129,25 @@ unique_ptr<Kubeconfig> Kubeconfig::load(const string &kubefile)
 
     const auto path = getKubeconfig(kubefile);
 
-    // Convert yaml file to json
-    auto json = fileToJson(path.string(), true);
+    const auto yaml = slurp(path.string());
+    const auto key = cache ? FileCache::key<Kubeconfig>("kubeconfig", yaml) : string{};
 
-    // Deserialize json to Kubeconfig instance
     auto kc = make_unique<Kubeconfig>();
-    std::istringstream ifs{json};
-    restc_cpp::serialize_properties_t properties;
-    properties.ignore_unknown_properties = true;
-    properties.name_mapping = &mappings;
-    restc_cpp::SerializeFromJson(*kc, ifs, properties);
+    if (!cache || !cache->load(key, *kc)) {
+        // Convert yaml file to json
+        auto json = yamlToJson(yaml, path.string());
+
+        // Deserialize json to Kubeconfig instance
+        std::istringstream ifs{json};
+        restc_cpp::serialize_properties_t properties;
+        properties.ignore_unknown_properties = true;
+        properties.name_mapping = &mappings;
+        restc_cpp::SerializeFromJson(*kc, ifs, properties);
+
+        if (cache) {
+            cache->store(key, *kc);
+        }
+    }
 
     if (kc->clusters.empty()) {
         throw runtime_error{"No clusters in kubeconfig: "s + path.string()};
@@ -0,0 +1,374 @@
+#include <locale>
+#include <optional>
+#include <string_view>
+#include <tuple>
+
+#include "k8deployer/MacroTemplate.h"
+#include "k8deployer/Component.h"
+#include "k8deployer/Engine.h"
+#include "k8deployer/logging.h"
+#include "k8deployer/exprtk_fn.h"
+
+extern char **environ;
+
+using namespace std;
+
+namespace k8deployer {
+
+namespace {
+
+bool toNumber(const string& value, double& number)
+{
+    if (value.empty() || value.find_first_not_of("0123456789+-.eE") != string::npos) {
+        return false;
+    }
+
+    char *end = {};
+    number = strtod(value.c_str(), &end);
+    return end == value.c_str() + value.size();
+}
+
+bool isTokenChar(char ch)
+{
+    return isalnum(ch, locale::classic()) || ch == '_' || ch == '.';
+}
+
+} // anon ns
+
+MacroTemplate::MacroTemplate(const string &text)
+{
+    // Var: ${varname[,default value]}
+    // Function: $name(arg)
+    // Default is unset/null
+
+    enum class State {
+        COPY,
+        BACKSLASH,
+        DOLLAR,
+        SCAN_NAME,
+        SCAN_DEFAUT_VALUE,
+        SCAN_FUNCTION_NAME,
+        SCAN_FUNCTION_ARG
+    };
+
+    locale loc{"C"};
+    string literal;
+    auto state = State::COPY;
+    string varName;
+    string functionName;
+    string functionArg;
+    int pharantheses = 0;
+    int braces = 0;
+    optional<string> defaultValue;
+    for(auto ch : text) {
+again:
+        switch(state) {
+        case State::COPY:
+            if (ch == '\\') {
+                state = State::BACKSLASH;
+                break;
+            }
+            if (ch == '$') {
+                state = State::DOLLAR;
+                break;
+            }
+            literal += ch;
+            break;
+        case State::BACKSLASH:
+            if (ch != '$') {
+                literal += '\\';
+            }
+            literal += ch;
+            state = State::COPY;
+            break;
+        case State::DOLLAR:
+            if (ch == '{') {
+                state = State::SCAN_NAME;
+                varName.clear();
+                defaultValue.reset();
+                break;
+            }
+            if (isalnum(ch, loc)) {
+                state = State::SCAN_FUNCTION_NAME;
+                functionName.clear();
+                functionArg.clear();
+                functionName += ch;
+                break;
+            }
+            literal += '$';
+            literal += ch;
+            state = State::COPY;
+            break;
+        case State::SCAN_NAME:
+            if (isalnum(ch, loc) || ch == '.' || ch == '_' || ch == ':') {
+                varName += ch;
+                break;
+            }
+            if (ch == ',') {
+                defaultValue.emplace();
+                state = State::SCAN_DEFAUT_VALUE;
+                braces = 1;
+                break;
+            }
+commit:
+            if (ch == '}') {
+                addLiteral(literal);
+                literal.clear();
+                addVariable(varName, defaultValue ? &*defaultValue : nullptr);
+                state = State::COPY;
+                break;
+            }
+
+            LOG_ERROR << "Error scanning variable-name starting with: " << varName;
+            throw runtime_error("Error expanding macro");
+
+        case State::SCAN_DEFAUT_VALUE:
+            // We may encounter recursive variables and functions here
+            if (ch == '{') {
+                ++braces;
+            }
+            if (ch == '}') {
+                if (--braces == 0) {
+                    goto commit;
+                }
+            }
+
+            if (ch == '"') {
+                *defaultValue  += '\\';
+            }
+            *defaultValue += ch;
+            break;
+
+        case State::SCAN_FUNCTION_NAME:
+            if (isalnum(ch, loc)) {
+                functionName += ch;
+                break;
+            }
+            if (ch == '(') {
+                pharantheses = 1;
+                state = State::SCAN_FUNCTION_ARG;
+                break;
+            }
+            // It's not a function!
+            // Treat the input as plain text and give it back
+            literal += '$';
+            literal += functionName;
+            state = State::COPY;
+            goto again; // This will parse `ch` using COPY state
+
+        case State::SCAN_FUNCTION_ARG:
+            if (ch == '(') {
+                ++pharantheses;
+            } else if (ch == ')') {
+               if (--pharantheses == 0) {
+                   addLiteral(literal);
+                   literal.clear();
+                   addFunction(functionName, functionArg);
+                   state = State::COPY;
+                   break;
+               }
+            }
+            functionArg += ch;
+            break;
+        }
+    }
+
+    // Like above, a trailing `\`, `$` or `$name` is plain text
+    if (state == State::BACKSLASH) {
+        literal += '\\';
+        state = State::COPY;
+    } else if (state == State::DOLLAR || state == State::SCAN_FUNCTION_NAME) {
+        literal += '$';
+        if (state == State::SCAN_FUNCTION_NAME) {
+            literal += functionName;
+        }
+        state = State::COPY;
+    }
+
+    if (state != State::COPY) {
+        if (state == State::SCAN_FUNCTION_ARG) {
+            LOG_ERROR << "Error expanding function macro " << functionName << ": Not properly terminated with '(...)'";
+        } else {
+            LOG_ERROR << "Error expanding macro " << varName << ": Not properly terminated with '}'";
+        }
+        throw runtime_error("Error expanding macro");
+    }
+
+    addLiteral(literal);
+}
+
+string MacroTemplate::expand(const variables_t &vars) const
+{
+    string expanded;
+    for(const auto& span : spans_) {
+        expanded += expand(span, vars);
+    }
+
+    return expanded;
+}
+
+string MacroTemplate::expand(const MacroTemplate::Span &span, const variables_t &vars) const
+{
+    switch(span.type) {
+    case Span::Type::LITERAL:
+        return span.text;
+    case Span::Type::VARIABLE:
+        return getVar(span, vars);
+    case Span::Type::FUNCTION:
+        if (!span.expression.empty()) {
+            return evalExpression(span, vars);
+        }
+        return execFunction(span.text, span.arg->expand(vars));
+    }
+
+    return {};
+}
+
+const unordered_map<string, string> &MacroTemplate::environment()
+{
+    static const auto env = [] {
+        unordered_map<string, string> env;
+        for(auto e = environ; e && *e; ++e) {
+            const string_view item{*e};
+            if (const auto eq = item.find('='); eq != string_view::npos) {
+                env.emplace(item.substr(0, eq), item.substr(eq + 1));
+            }
+        }
+        return env;
+    }();
+
+    return env;
+}
+
+void MacroTemplate::addLiteral(const string &text)
+{
+    if (text.empty()) {
+        return;
+    }
+
+    if (!spans_.empty() && spans_.back().type == Span::Type::LITERAL) {
+        spans_.back().text += text;
+        return;
+    }
+
+    Span span;
+    span.text = text;
+    spans_.push_back(move(span));
+}
+
+void MacroTemplate::addVariable(const string &name, const string *defaultValue)
+{
+    Span span;
+    span.type = Span::Type::VARIABLE;
+    span.text = name;
+    if (defaultValue) {
+        span.arg = make_shared<MacroTemplate>(*defaultValue);
+    }
+
+    tie(span.isClusterVar, span.clusterIx, span.clusterVarName) = Engine::parseClusterVar(name);
+    spans_.push_back(move(span));
+}
+
+void MacroTemplate::addFunction(const string &name, const string &arg)
+{
+    Span span;
+    span.type = Span::Type::FUNCTION;
+    span.text = name;
+    span.arg = make_shared<MacroTemplate>(arg);
+    if (isExpressionFunction(name)) {
+        span.expression = span.arg->toExpression();
+    }
+    spans_.push_back(move(span));
+}
+
+string MacroTemplate::getVar(const MacroTemplate::Span &span, const variables_t &vars) const
+{
+    if (span.isClusterVar) {
+        return Engine::instance().getClusterVar(span.clusterIx, span.clusterVarName);
+    }
+
+    if (auto it = vars.find(span.text); it != vars.end()) {
+        return it->second;
+    }
+
+    const auto& env = environment();
+    if (auto it = env.find(span.text); it != env.end()) {
+        return it->second;
+    }
+
+    if (span.arg) {
+        auto value = span.arg->expand(vars);
+
+        // A default value like `$NAME` is taken from the environment, if it's set
+        if (value.size() > 1 && value[0] == '$' && value[1] != '(') {
+            if (auto it = env.find(value.substr(1)); it != env.end()) {
+                return it->second;
+            }
+        }
+
+        return value;
+    }
+
+    return {};
+}
+
+string MacroTemplate::evalExpression(const MacroTemplate::Span &span, const variables_t &vars) const
+{
+    const auto& argSpans = span.arg->spans_;
+    vector<string> values;
+    vector<double> args;
+    bool numbers = true;
+    for(const auto& as : argSpans) {
+        if (as.type != Span::Type::LITERAL) {
+            values.push_back(span.arg->expand(as, vars));
+            double number = 0;
+            if (numbers && toNumber(values.back(), number)) {
+                args.push_back(number);
+            } else {
+                numbers = false;
+            }
+        }
+    }
+
+    if (numbers) {
+        return execFunction(span.text, exprtkDouble(span.expression, args));
+    }
+
+    // Some macro is not a number. Use the expanded text.
+    string text;
+    size_t ix = 0;
+    for(const auto& as : argSpans) {
+        text += as.type == Span::Type::LITERAL ? as.text : values.at(ix++);
+    }
+
+    return execFunction(span.text, text);
+}
+
+string MacroTemplate::toExpression() const
+{
+    string expression;
+    size_t ix = 0;
+    for(size_t i = 0; i < spans_.size(); ++i) {
+        const auto& span = spans_[i];
+        if (span.type == Span::Type::LITERAL) {
+            expression += span.text;
+            continue;
+        }
+
+        // A macro that is glued to something else, like `1${a}`, must be expanded as text
+        if (i > 0 && (spans_[i - 1].type != Span::Type::LITERAL
+                      || isTokenChar(spans_[i - 1].text.back()))) {
+            return {};
+        }
+        if (i + 1 < spans_.size() && (spans_[i + 1].type != Span::Type::LITERAL
+                                      || isTokenChar(spans_[i + 1].text.front()))) {
+            return {};
+        }
+
+        expression += exprtkArgName(ix++);
+    }
+
+    return ix ? expression : string{};
+}
+
+} // ns
@@ -46,7 +46,7 @@ bool NamespaceComponent::probe(std::function<void (Component::K8ObjectState)> fn
                     fn(state);
                 }
             }, [](const auto& data) {
-                if (Engine::mode() == Engine::Mode::DEPLOY) {
+                if (Engine::isApplying()) {
                     if (data.status) {
                         return data.status->phase == "Active";
                     }
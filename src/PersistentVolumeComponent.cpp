@@ -23,7 +23,8 @@ PersistentVolumeComponent::PersistentVolumeComponent(const Component::ptr_t &par
 
 void PersistentVolumeComponent::prepareDeploy()
 {
-    if (auto st = cluster_->getStorage()) {
+    // Don't create directories for volumes that are not deployed
+    if (auto st = cluster_->getStorage(); st && Engine::mode() != Engine::Mode::SIMULATE) {
         persistentVolume = st->createNewVolume(getArg("pv.capacity", "1Gi"), *this);
     }
 
@@ -35,6 +36,11 @@ void PersistentVolumeComponent::prepareDeploy()
         persistentVolume.metadata.namespace_ = getNamespace();
     }
 
+    // So we can find it with a label-selector
+    for (const auto& label : labels) {
+        persistentVolume.metadata.labels.emplace(label);
+    }
+
     persistentVolume.spec.claimRef["namespace"] = getNamespace();
     persistentVolume.spec.claimRef["name"] = name;
 
@@ -53,7 +59,7 @@ bool PersistentVolumeComponent::probe(std::function<void (Component::K8ObjectSta
                     fn(state);
                 }
             }, [] (const auto& data) {
-                if (Engine::mode() == Engine::Mode::DEPLOY) {
+                if (Engine::isApplying()) {
                     return data.status->phase == "Available";
                 }
                 return false;
@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <cctype>
+#include <ctime>
+
+#include "k8deployer/RequestGovernor.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+using namespace restc_cpp;
+
+namespace k8deployer {
+
+namespace {
+constexpr double initialWindow = 8.0;
+constexpr auto maxBackoff = chrono::seconds{30};
+constexpr auto maxRetryAfter = chrono::seconds{300};
+
+// Retry-After is either a number of seconds or a http date
+optional<chrono::seconds> parseRetryAfter(const string& value)
+{
+    if (!value.empty() && value.size() < 10
+            && all_of(value.begin(), value.end(), [](char ch) { return isdigit(ch); })) {
+        return chrono::seconds{stol(value)};
+    }
+
+    tm when = {};
+    if (const auto end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &when); end && !*end) {
+        const auto delay = chrono::system_clock::from_time_t(timegm(&when)) - chrono::system_clock::now();
+        return max(chrono::duration_cast<chrono::seconds>(delay), chrono::seconds{0});
+    }
+
+    return {};
+}
+
+} // anon ns
+
+RequestGovernor::RequestGovernor(RestClient &client, string name,
+                                 size_t maxInFlight, chrono::milliseconds latencyThreshold,
+                                 const Request::Properties& properties)
+    : client_{client}, name_{move(name)}, maxInFlight_{max<size_t>(maxInFlight, 1)}
+    , latencyThreshold_{latencyThreshold}
+    , requestProperties_{make_shared<Request::Properties>(properties)}
+    , window_{min(initialWindow, static_cast<double>(maxInFlight_))}
+    , timer_{client.GetIoService()}
+{
+    requestProperties_->throwOnHttpError = false;
+}
+
+void RequestGovernor::process(RequestGovernor::fn_t fn)
+{
+    deque<fn_t> runnable;
+    {
+        lock_guard<mutex> lock{mutex_};
+        queue_.push_back(move(fn));
+        runnable = takeRunnable();
+
+        if (!queue_.empty()) {
+            LOG_TRACE << name_ << " Request queued. In flight: " << inFlight_
+                      << ", window: " << window_ << ", queued: " << queue_.size();
+        }
+    }
+
+    startAll(move(runnable));
+}
+
+void RequestGovernor::start(RequestGovernor::fn_t fn)
+{
+    client_.Process([this, fn=move(fn)](Context& ctx) {
+        const auto started = clock_t::now();
+        try {
+            fn(ctx);
+        } catch(const ThrottledException& err) {
+            onThrottled(fn, err.retryAfter);
+            return;
+        } catch(const RequestFailedWithErrorException& err) {
+            if (isThrottled(err)) {
+                onThrottled(fn, {});
+                return;
+            }
+            LOG_WARN << name_ << " Unhandled request failure: " << err.what();
+        } catch(const exception& ex) {
+            LOG_WARN << name_ << " Unhandled request failure: " << ex.what();
+        }
+
+        onCompleted(clock_t::now() - started);
+    });
+}
+
+void RequestGovernor::onCompleted(clock_t::duration latency)
+{
+    deque<fn_t> runnable;
+    {
+        lock_guard<mutex> lock{mutex_};
+        assert(inFlight_ > 0);
+        --inFlight_;
+        throttled_ = 0;
+
+        const auto now = clock_t::now();
+        if (latency > latencyThreshold_) {
+            // Only decrease once for the requests that were in flight together
+            if (now - lastDecrease_ > latencyThreshold_) {
+                lastDecrease_ = now;
+                window_ = max(window_ / 2.0, 1.0);
+                LOG_DEBUG << name_ << " Request latency "
+                          << chrono::duration_cast<chrono::milliseconds>(latency).count()
+                          << " ms. Reducing window to " << window_;
+            }
+        } else {
+            window_ = min(window_ + 1.0 / window_, static_cast<double>(maxInFlight_));
+        }
+
+        runnable = takeRunnable();
+    }
+
+    startAll(move(runnable));
+}
+
+unique_ptr<Reply> RequestGovernor::execute(RequestBuilder &builder) const
+{
+    auto reply = builder.Properties(requestProperties_).Execute();
+    const auto& response = reply->GetHttpResponse();
+
+    if (response.status_code == 429) {
+        optional<chrono::seconds> retryAfter;
+        if (const auto value = reply->GetHeader("Retry-After")) {
+            retryAfter = parseRetryAfter(*value);
+        }
+        throw ThrottledException{response, retryAfter};
+    }
+
+    if (response.status_code >= 400) {
+        throw RequestFailedWithErrorException{response};
+    }
+
+    return reply;
+}
+
+void RequestGovernor::onThrottled(RequestGovernor::fn_t fn, optional<chrono::seconds> retryAfter)
+{
+    lock_guard<mutex> lock{mutex_};
+    assert(inFlight_ > 0);
+    --inFlight_;
+
+    const auto backoff = retryAfter
+            ? min<clock_t::duration>(*retryAfter, maxRetryAfter)
+            : min<clock_t::duration>(chrono::seconds{1 << min(throttled_, 5u)}, maxBackoff);
+    ++throttled_;
+
+    const auto now = clock_t::now();
+    lastDecrease_ = now;
+    window_ = max(window_ / 2.0, 1.0);
+    holdUntil_ = max(holdUntil_, now + backoff);
+
+    LOG_DEBUG << name_ << " Request throttled by the server. Reducing window to " << window_
+              << " and retrying in "
+              << chrono::duration_cast<chrono::milliseconds>(backoff).count() << " ms";
+
+    queue_.push_front(move(fn));
+    setResumeTimer(holdUntil_ - now);
+}
+
+deque<RequestGovernor::fn_t> RequestGovernor::takeRunnable()
+{
+    deque<fn_t> runnable;
+
+    if (clock_t::now() < holdUntil_) {
+        return runnable;
+    }
+
+    while(!queue_.empty() && inFlight_ < static_cast<size_t>(window_)) {
+        runnable.push_back(move(queue_.front()));
+        queue_.pop_front();
+        ++inFlight_;
+    }
+
+    return runnable;
+}
+
+void RequestGovernor::startAll(deque<RequestGovernor::fn_t> runnable)
+{
+    for(auto& fn : runnable) {
+        start(move(fn));
+    }
+}
+
+void RequestGovernor::setResumeTimer(clock_t::duration delay)
+{
+    if (timerPending_) {
+        return;
+    }
+
+    timerPending_ = true;
+    timer_.expires_from_now(boost::posix_time::milliseconds(
+                                chrono::duration_cast<chrono::milliseconds>(delay).count()));
+    timer_.async_wait([this](const boost::system::error_code& ec) {
+        deque<fn_t> runnable;
+        {
+            lock_guard<mutex> lock{mutex_};
+            timerPending_ = false;
+            if (ec) {
+                return;
+            }
+
+            if (const auto now = clock_t::now(); now < holdUntil_) {
+                setResumeTimer(holdUntil_ - now);
+                return;
+            }
+
+            runnable = takeRunnable();
+        }
+
+        startAll(move(runnable));
+    });
+}
+
+} // ns
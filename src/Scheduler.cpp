@@ -0,0 +1,173 @@
+#include "k8deployer/Scheduler.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+namespace {
+
+// Rough guesses, only used to order the READY tasks
+double defaultEstimate(Kind kind) {
+    switch(kind) {
+    case Kind::APP:
+        return 0.0;
+    case Kind::STATEFULSET:
+    case Kind::JOB:
+        return 60.0;
+    case Kind::DEPLOYMENT:
+    case Kind::DAEMONSET:
+        return 30.0;
+    case Kind::PERSISTENTVOLUME:
+    case Kind::INGRESS:
+    case Kind::NAMESPACE:
+        return 5.0;
+    case Kind::SERVICE:
+    case Kind::HTTP_REQUEST:
+        return 2.0;
+    default:
+        return 1.0;
+    }
+}
+
+} // anon ns
+
+Scheduler::Scheduler(const Component::tasks_t &tasks, DependencyGraph graph)
+    : graph_{move(graph)}
+{
+    assert(graph_.size() == tasks.size());
+
+    byId_.reserve(tasks.size());
+    for(const auto& task : tasks) {
+        assert(task->id() == byId_.size());
+        byId_.push_back(task.get());
+        task->pendingDependencies_ = 0;
+        task->failedDependencies_ = 0;
+    }
+
+    // The initial counters
+    for(const auto& task : tasks) {
+        for(const auto dep : task->dependencies()) {
+            if (dep->state() != Task::TaskState::DONE) {
+                ++task->pendingDependencies_;
+            }
+            if (dep->state() >= Task::TaskState::ABORTED) {
+                ++task->failedDependencies_;
+            }
+        }
+    }
+
+    calculateCriticalPaths();
+}
+
+double Scheduler::estimatedDuration(const Component &component)
+{
+    return component.getIntArg("estimate.seconds", static_cast<int>(defaultEstimate(component.kind_)));
+}
+
+// The graph is already verified to be free from cycles by prepareTasks(),
+// so all the tasks are in the topological order.
+void Scheduler::calculateCriticalPaths()
+{
+    const auto order = graph_.sortTopologically();
+    assert(order.size() == byId_.size());
+
+    // Dependents first
+    for(auto it = order.rbegin(); it != order.rend(); ++it) {
+        auto& task = *byId_[*it];
+        double longest = 0.0;
+        for(const auto dependent : graph_.edges(*it)) {
+            longest = max(longest, byId_[dependent]->criticalPath_);
+        }
+
+        task.criticalPath_ = estimatedDuration(task.component()) + longest;
+    }
+}
+
+void Scheduler::touch(Component &component, bool includeTasks)
+{
+    components_.push(&component);
+
+    if (includeTasks) {
+        for(auto task : component.ownTasks_) {
+            tasks_.push(task);
+        }
+    }
+}
+
+void Scheduler::touch(Task &task)
+{
+    tasks_.push(&task);
+}
+
+void Scheduler::setReady(Task &task)
+{
+    if (ready_.push(&task)) {
+        LOG_TRACE << task.component().logName() << "Task " << task.name()
+                  << " is queued for execution. Critical path is " << task.criticalPath_ << " seconds";
+    }
+}
+
+Component *Scheduler::nextComponent()
+{
+    return components_.pop();
+}
+
+Scheduler::Task *Scheduler::nextTask()
+{
+    return tasks_.pop();
+}
+
+Scheduler::Task *Scheduler::nextReady()
+{
+    return ready_.pop();
+}
+
+void Scheduler::onStateChanged(Task &task, Task::TaskState from, Task::TaskState to)
+{
+    const bool wasDone = from == Task::TaskState::DONE;
+    const bool isDone = to == Task::TaskState::DONE;
+    const bool wasFailed = from >= Task::TaskState::ABORTED;
+    const bool isFailed = to >= Task::TaskState::ABORTED;
+
+    for(const auto id : graph_.edges(task.id())) {
+        auto dependent = byId_[id];
+        if (wasDone != isDone) {
+            if (isDone) {
+                assert(dependent->pendingDependencies_ > 0);
+                --dependent->pendingDependencies_;
+            } else {
+                ++dependent->pendingDependencies_;
+            }
+        }
+
+        if (wasFailed != isFailed) {
+            if (isFailed) {
+                ++dependent->failedDependencies_;
+            } else {
+                assert(dependent->failedDependencies_ > 0);
+                --dependent->failedDependencies_;
+            }
+        }
+
+        touch(*dependent);
+    }
+
+    touch(task);
+    touch(task.component());
+}
+
+void Scheduler::onStateChanged(Component &component)
+{
+    touch(component, true);
+
+    if (auto parent = component.parent_.lock()) {
+        touch(*parent);
+    }
+
+    for(auto dependent : component.dependents_) {
+        touch(*dependent, true);
+    }
+}
+
+} // ns
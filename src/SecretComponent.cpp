@@ -129,59 +129,16 @@ void SecretComponent::addRemovementTasks(Component::tasks_t &tasks)
 
 void SecretComponent::doDeploy(std::weak_ptr<Component::Task> task)
 {
-    auto url = cluster_->getUrl()
+    assert(secret);
+    sendApply(*secret, getCreationUrl(), task);
+}
+
+string SecretComponent::getCreationUrl() const
+{
+    return cluster_->getUrl()
             + "/api/v1/namespaces/"
             + getNamespace()
             + "/secrets";
-
-    client().Process([this, url, task](Context& ctx) {
-
-        LOG_DEBUG << logName()
-                  << "Sending Secret "
-                  << secret->metadata.name;
-
-        assert(secret);
-        LOG_TRACE << "Payload: " << toJson(*secret);
-
-        try {
-            auto reply = RequestBuilder{ctx}.Post(url)
-               .Data(secret, jsonFieldMappings())
-               .Execute();
-
-            LOG_DEBUG << logName()
-                  << "Applying gave response: "
-                  << reply->GetResponseCode() << ' '
-                  << reply->GetHttpResponse().reason_phrase;
-
-            // We don't get any event's related to the service, so just update the states.
-            if (auto taskInstance = task.lock()) {
-                taskInstance->setState(Task::TaskState::DONE);
-            }
-
-            if (state_ == State::RUNNING) {
-                setIsDone();
-            }
-
-            return;
-        } catch(const RequestFailedWithErrorException& err) {
-            LOG_WARN << logName()
-                     << "Request failed: " << err.http_response.status_code
-                     << ' ' << err.http_response.reason_phrase
-                     << ": " << err.what();
-        } catch(const std::exception& ex) {
-            LOG_WARN << logName()
-                     << "Request failed: " << ex.what();
-        }
-
-        if (auto taskInstance = task.lock()) {
-            taskInstance->setState(Task::TaskState::FAILED);
-        }
-
-        if (state_ == State::RUNNING) {
-            setState(State::FAILED);
-        }
-
-    });
 }
 
 void SecretComponent::doRemove(std::weak_ptr<Component::Task> task)
@@ -191,15 +148,14 @@ void SecretComponent::doRemove(std::weak_ptr<Component::Task> task)
             + secret->metadata.namespace_
             + "/secrets/" + name;
 
-    client().Process([this, url, task](Context& ctx) {
+    cluster().governor().process([this, url, task](Context& ctx) {
 
         LOG_DEBUG << logName()
                   << "Deleting Secret "
                   << name;
 
         try {
-            auto reply = RequestBuilder{ctx}.Delete(url)
-               .Execute();
+            auto reply = cluster().governor().execute(RequestBuilder{ctx}.Delete(url));
 
             LOG_DEBUG << logName()
                   << "Deleting gave response: "
@@ -213,6 +169,10 @@ void SecretComponent::doRemove(std::weak_ptr<Component::Task> task)
 
             return;
         } catch(const RequestFailedWithErrorException& err) {
+            if (RequestGovernor::isThrottled(err)) {
+                throw; // Let the governor retry
+            }
+
             if (err.http_response.status_code == 404) {
                 // Perfectly OK
                 if (auto taskInstance = task.lock()) {
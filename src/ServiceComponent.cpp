@@ -100,7 +100,7 @@ bool ServiceComponent::probe(std::function<void (Component::K8ObjectState)> fn)
                 }
             }, [](const auto& data) {
                 // If it exists, it's probably OK...
-                return Engine::mode() == Engine::Mode::DEPLOY;
+                return Engine::isApplying();
             }
         );
     }
@@ -121,6 +121,8 @@ void ServiceComponent::addDeploymentTasks(Component::tasks_t &tasks)
         task.evaluate();
     });
 
+    task->startProbeAfterApply = true;
+
     tasks.push_back(task);
     Component::addDeploymentTasks(tasks);
 }
@@ -144,56 +146,15 @@ void ServiceComponent::addRemovementTasks(Component::tasks_t &tasks)
 
 void ServiceComponent::doDeploy(std::weak_ptr<Component::Task> task)
 {
-    auto url = cluster_->getUrl()
+    sendApply(service, getCreationUrl(), task);
+}
+
+string ServiceComponent::getCreationUrl() const
+{
+    return cluster_->getUrl()
             + "/api/v1/namespaces/"
             + getNamespace()
             + "/services";
-
-    client().Process([this, url, task](Context& ctx) {
-
-        LOG_DEBUG << logName()
-                  << "Sending Service "
-                  << service.metadata.name;
-
-        LOG_TRACE << "Payload: " << toJson(service);
-
-        try {
-            auto reply = RequestBuilder{ctx}.Post(url)
-               .Data(service, jsonFieldMappings())
-               .Execute();
-
-            LOG_DEBUG << logName()
-                  << "Applying gave response: "
-                  << reply->GetResponseCode() << ' '
-                  << reply->GetHttpResponse().reason_phrase;
-
-            if (state_ == State::RUNNING) {
-                if (auto taskInstance = task.lock()) {
-                    taskInstance->setState(Task::TaskState::WAITING);
-                    taskInstance->schedulePoll();
-                }
-            }
-
-            return;
-        } catch(const RequestFailedWithErrorException& err) {
-            LOG_WARN << logName()
-                     << "Request failed: " << err.http_response.status_code
-                     << ' ' << err.http_response.reason_phrase
-                     << ": " << err.what();
-        } catch(const std::exception& ex) {
-            LOG_WARN << logName()
-                     << "Request failed: " << ex.what();
-        }
-
-        if (auto taskInstance = task.lock()) {
-            taskInstance->setState(Task::TaskState::FAILED);
-        }
-
-        if (state_ == State::RUNNING) {
-            setState(State::FAILED);
-        }
-
-    });
 }
 
 void ServiceComponent::doRemove(std::weak_ptr<Component::Task> task)
@@ -203,15 +164,14 @@ void ServiceComponent::doRemove(std::weak_ptr<Component::Task> task)
             + service.metadata.namespace_
             + "/services/" + name;
 
-    client().Process([this, url, task](Context& ctx) {
+    cluster().governor().process([this, url, task](Context& ctx) {
 
         LOG_DEBUG << logName()
                   << "Deleting Service "
                   << service.metadata.name;
 
         try {
-            auto reply = RequestBuilder{ctx}.Delete(url)
-               .Execute();
+            auto reply = cluster().governor().execute(RequestBuilder{ctx}.Delete(url));
 
             LOG_DEBUG << logName()
                   << "Deletion gave response: "
@@ -223,6 +183,10 @@ void ServiceComponent::doRemove(std::weak_ptr<Component::Task> task)
             }
             return;
         } catch(const RequestFailedWithErrorException& err) {
+            if (RequestGovernor::isThrottled(err)) {
+                throw; // Let the governor retry
+            }
+
             if (err.http_response.status_code == 404) {
                 // Perfectly OK
                 if (auto taskInstance = task.lock()) {
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <queue>
+#include <sstream>
+
+#include <boost/algorithm/string.hpp>
+
+#include "k8deployer/Simulator.h"
+#include "k8deployer/Scheduler.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+namespace {
+
+Simulator::Distribution::Type toDistributionType(const string& name) {
+    static const map<string, Simulator::Distribution::Type> types = {
+        {"fixed", Simulator::Distribution::Type::FIXED},
+        {"uniform", Simulator::Distribution::Type::UNIFORM},
+        {"normal", Simulator::Distribution::Type::NORMAL},
+        {"lognormal", Simulator::Distribution::Type::LOGNORMAL},
+        {"exponential", Simulator::Distribution::Type::EXPONENTIAL}
+    };
+
+    if (auto it = types.find(name); it != types.end()) {
+        return it->second;
+    }
+
+    throw runtime_error("Unknown distribution: "s + name);
+}
+
+} // anon ns
+
+double Simulator::Distribution::sample(mt19937_64 &rnd) const
+{
+    double value = a;
+
+    switch(type) {
+    case Type::FIXED:
+        break;
+    case Type::UNIFORM:
+        value = uniform_real_distribution<double>{a, max(a, b)}(rnd);
+        break;
+    case Type::NORMAL:
+        if (b > 0.0) {
+            value = normal_distribution<double>{a, b}(rnd);
+        }
+        break;
+    case Type::LOGNORMAL:
+        if (a > 0.0 && b > 0.0) {
+            // a and b are the mean and standard deviation of the result
+            const auto s2 = log(1.0 + (b * b) / (a * a));
+            value = lognormal_distribution<double>{log(a) - s2 / 2.0, sqrt(s2)}(rnd);
+        }
+        break;
+    case Type::EXPONENTIAL:
+        if (a > 0.0) {
+            value = exponential_distribution<double>{1.0 / a}(rnd);
+        }
+        break;
+    }
+
+    return max(value, 0.0);
+}
+
+Simulator::Simulator(Component &root, Simulator::model_t model, uint64_t seed)
+    : root_{root}, model_{move(model)}, rnd_{seed}
+{
+}
+
+Simulator::model_t Simulator::loadModel(const string &path)
+{
+    ifstream in{path};
+    if (!in.is_open()) {
+        LOG_ERROR << "Failed to open latency model: " << path;
+        throw runtime_error("Failed to open latency model: "s + path);
+    }
+
+    model_t model;
+    string line;
+    for(size_t lineNo = 1; getline(in, line); ++lineNo) {
+        istringstream tokens{line};
+        string key, type;
+        if (!(tokens >> key) || key.front() == '#') {
+            continue;
+        }
+
+        Distribution d;
+        if (!(tokens >> type >> d.a)) {
+            LOG_ERROR << "Invalid latency model in " << path << " at line " << lineNo << ": " << line;
+            throw runtime_error("Invalid latency model");
+        }
+
+        d.type = toDistributionType(type);
+        tokens >> d.b;
+        model[key] = d;
+    }
+
+    LOG_DEBUG << "Loaded " << model.size() << " latencies from " << path;
+    return model;
+}
+
+void Simulator::saveTimings(Component &root, ostream &out)
+{
+    out << "# Elapsed seconds for the tasks in deployment " << root.name << endl;
+    root.forAllComponents([&](Component& c) {
+        for(const auto task : c.ownTasks_) {
+            if (const auto elapsed = task->elapsed()) {
+                out << taskKey(c, *task) << " fixed " << fixed << setprecision(3) << *elapsed << endl;
+            }
+        }
+    });
+}
+
+void Simulator::run(size_t runs)
+{
+    build();
+
+    vector<double> makespans;
+    for(size_t i = 0; i < max<size_t>(runs, 1); ++i) {
+        const auto result = simulate();
+        if (i == 0) {
+            report(result);
+        }
+        makespans.push_back(result.makespan);
+    }
+
+    if (makespans.size() > 1) {
+        sort(makespans.begin(), makespans.end());
+        auto percentile = [&makespans](double p) {
+            return makespans.at(min(makespans.size() - 1,
+                                    static_cast<size_t>(p * makespans.size())));
+        };
+
+        LOG_INFO << root_.logName() << "Makespan over " << makespans.size() << " runs: "
+                 << fixed << setprecision(1)
+                 << "min " << makespans.front()
+                 << ", p50 " << percentile(0.5)
+                 << ", p90 " << percentile(0.9)
+                 << ", max " << makespans.back() << " seconds";
+    }
+}
+
+void Simulator::build()
+{
+    nodes_.clear();
+    starts_.clear();
+    dones_.clear();
+    tasks_.clear();
+
+    root_.forAllComponents([this](Component& c) {
+        starts_[&c] = add(Node::Type::START, &c);
+        dones_[&c] = add(Node::Type::DONE, &c);
+        for(auto task : c.ownTasks_) {
+            tasks_[task] = add(Node::Type::TASK, &c, task);
+        }
+    });
+
+    root_.forAllComponents([this](Component& c) {
+        const auto start = starts_.at(&c);
+        const auto done = dones_.at(&c);
+
+        for(const auto dep : c.dependsOn_) {
+            if (auto it = dones_.find(dep); it != dones_.end()) {
+                addDependency(start, it->second);
+            }
+        }
+
+        for(const auto& child : c.children_) {
+            const auto childDone = dones_.at(child.get());
+            if (child->parentRelation() == Component::ParentRelation::BEFORE) {
+                addDependency(start, childDone);
+            }
+            addDependency(done, childDone);
+        }
+
+        addDependency(done, start);
+
+        for(auto task : c.ownTasks_) {
+            const auto node = tasks_.at(task);
+            addDependency(node, start);
+            addDependency(done, node);
+
+            for(const auto dep : task->dependencies()) {
+                addDependency(node, tasks_.at(dep));
+            }
+        }
+    });
+}
+
+size_t Simulator::add(Simulator::Node::Type type, Component *component, Component::Task *task)
+{
+    Node node;
+    node.type = type;
+    node.component = component;
+    node.task = task;
+    nodes_.push_back(move(node));
+    return nodes_.size() - 1;
+}
+
+void Simulator::addDependency(size_t node, size_t dependency)
+{
+    auto& deps = nodes_.at(dependency).dependents;
+    if (find(deps.begin(), deps.end(), node) == deps.end()) {
+        deps.push_back(node);
+        ++nodes_.at(node).numDependencies;
+    }
+}
+
+double Simulator::duration(const Simulator::Node &node)
+{
+    auto& c = *node.component;
+
+    switch(node.type) {
+    case Node::Type::START:
+        return c.getIntArg("delay.before", 0) + c.getIntArg("delay.sequence", 0);
+    case Node::Type::DONE:
+        return c.getIntArg("delay.after", 0);
+    case Node::Type::TASK:
+        if (auto it = model_.find(taskKey(c, *node.task)); it != model_.end()) {
+            return it->second.sample(rnd_);
+        }
+        if (auto it = model_.find("component:"s + c.name); it != model_.end()) {
+            return it->second.sample(rnd_);
+        }
+        if (auto it = model_.find(Component::toString(c.getKind())); it != model_.end()) {
+            return it->second.sample(rnd_);
+        }
+        return Scheduler::estimatedDuration(c);
+    }
+
+    return 0.0;
+}
+
+Simulator::Result Simulator::simulate()
+{
+    // Finished nodes, ordered by time. The index breaks ties, so runs are repeatable.
+    using event_t = pair<double, size_t>;
+    priority_queue<event_t, vector<event_t>, greater<event_t>> events;
+
+    size_t running = 0;
+    Result result;
+
+    auto begin = [&](size_t ix, double now) {
+        auto& node = nodes_[ix];
+        node.started = now;
+        node.done = now + node.duration;
+        events.emplace(node.done, ix);
+        if (node.type == Node::Type::TASK) {
+            result.peakConcurrency = max(result.peakConcurrency, ++running);
+        }
+    };
+
+    for(auto& node : nodes_) {
+        node.pending = node.numDependencies;
+        node.duration = duration(node);
+        node.started = node.done = -1.0;
+        node.cause = -1;
+    }
+
+    for(size_t ix = 0; ix < nodes_.size(); ++ix) {
+        if (nodes_[ix].pending == 0) {
+            begin(ix, 0.0);
+        }
+    }
+
+    size_t finished = 0;
+    while(!events.empty()) {
+        const auto [now, ix] = events.top();
+        events.pop();
+        ++finished;
+        result.makespan = now;
+
+        if (nodes_[ix].type == Node::Type::TASK) {
+            --running;
+        }
+
+        for(const auto dependent : nodes_[ix].dependents) {
+            auto& node = nodes_[dependent];
+            assert(node.pending > 0);
+            if (--node.pending == 0) {
+                node.cause = static_cast<int>(ix);
+                begin(dependent, now);
+            }
+        }
+    }
+
+    if (finished != nodes_.size()) {
+        for(const auto& node : nodes_) {
+            if (node.done < 0.0) {
+                LOG_ERROR << "Simulation: " << describe(node) << " never started";
+            }
+        }
+        throw runtime_error("The simulation got stuck. Circular dependency?");
+    }
+
+    return result;
+}
+
+void Simulator::report(const Simulator::Result &result) const
+{
+    for(const auto& node : nodes_) {
+        if (node.type == Node::Type::TASK) {
+            LOG_DEBUG << "Simulation: " << describe(node) << fixed << setprecision(1)
+                      << " runs from " << node.started << " to " << node.done;
+        }
+    }
+
+    LOG_INFO << root_.logName() << "Predicted makespan: " << fixed << setprecision(1)
+             << result.makespan << " seconds";
+    LOG_INFO << root_.logName() << "Peak concurrency: " << result.peakConcurrency << " tasks";
+
+    // Walk back from the node that finished last
+    auto last = max_element(nodes_.begin(), nodes_.end(), [](const auto& a, const auto& b) {
+        return a.done < b.done;
+    });
+
+    vector<const Node *> path;
+    for(int ix = last == nodes_.end() ? -1 : static_cast<int>(distance(nodes_.begin(), last));
+        ix >= 0; ix = nodes_[ix].cause) {
+        const auto& node = nodes_[ix];
+        if (node.type == Node::Type::TASK || node.duration > 0.0) {
+            path.push_back(&node);
+        }
+    }
+
+    LOG_INFO << root_.logName() << "Critical path:";
+    for(auto it = path.rbegin(); it != path.rend(); ++it) {
+        LOG_INFO << "   " << fixed << setprecision(1) << setw(8) << (*it)->started
+                 << " - " << setw(8) << (*it)->done << "  " << describe(**it);
+    }
+}
+
+string Simulator::taskKey(const Component &component, const Component::Task &task)
+{
+    return "task:"s + component.name + "/" + task.name();
+}
+
+string Simulator::describe(const Simulator::Node &node) const
+{
+    const auto name = boost::trim_right_copy(node.component->logName());
+    switch(node.type) {
+    case Node::Type::START:
+        return name + " delay.before";
+    case Node::Type::DONE:
+        return name + " delay.after";
+    case Node::Type::TASK:
+        return name + " task " + node.task->name();
+    }
+
+    return name;
+}
+
+} // ns
@@ -0,0 +1,88 @@
+#include <memory>
+#include <set>
+
+#include "k8deployer/StateBus.h"
+#include "k8deployer/Cluster.h"
+#include "k8deployer/Component.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+StateBus::StateBus(boost::asio::io_service &io)
+    : io_{io}
+{
+}
+
+StateBus::~StateBus()
+{
+    auto msg = head_.exchange(nullptr);
+    while(msg) {
+        auto next = msg->next;
+        delete msg;
+        msg = next;
+    }
+}
+
+void StateBus::subscribe(const Cluster &source, const string &name,
+                         Component &subscriber, StateBus::fn_t fn)
+{
+    subscribers_[{&source, name}].push_back({&subscriber, move(fn)});
+}
+
+void StateBus::publish(const Component &source, StateBus::state_t state)
+{
+    auto msg = new Message{&source, state, head_.load(memory_order_relaxed)};
+    while(!head_.compare_exchange_weak(msg->next, msg,
+                                       memory_order_release,
+                                       memory_order_relaxed))
+        ;
+
+    if (!msg->next) {
+        // The inbox was empty, so there is no drain pending
+        io_.post([this] {
+            drain();
+        });
+    }
+}
+
+void StateBus::drain()
+{
+    auto msg = head_.exchange(nullptr, memory_order_acquire);
+
+    // The list is newest first. Reverse it to get the publishing order.
+    Message *batch = {};
+    while(msg) {
+        auto next = msg->next;
+        msg->next = batch;
+        batch = msg;
+        msg = next;
+    }
+
+    set<Component *> touched;
+    size_t count = 0;
+    while(batch) {
+        unique_ptr<Message> current{batch};
+        batch = batch->next;
+        ++count;
+
+        // The name and cluster of a component never change, so it's safe to read them here
+        if (auto it = subscribers_.find({&current->source->cluster(), current->source->name});
+                it != subscribers_.end()) {
+            for(auto& sub : it->second) {
+                sub.fn(current->state);
+                touched.insert(sub.component);
+            }
+        }
+    }
+
+    LOG_TRACE << "StateBus: Drained " << count << " state changes for "
+              << touched.size() << " components.";
+
+    for(auto component : touched) {
+        component->scheduleRunTasks();
+    }
+}
+
+} // ns
@@ -12,6 +12,43 @@ using namespace restc_cpp;
 
 namespace k8deployer {
 
+namespace {
+
+// Same rules as `kubectl rollout status`; the controller has seen the
+// current generation, and all the pods are ready and from the new revision.
+bool isRolledOut(const k8api::StatefulSet& data, int appliedGeneration)
+{
+    if (!data.status) {
+        return false;
+    }
+
+    const auto& status = *data.status;
+    const size_t replicas = (data.spec && data.spec->replicas ? *data.spec->replicas : 1);
+    const auto generation = data.metadata ? data.metadata->generation : 0;
+
+    // Like `kubectl rollout status`: With OnDelete, the pods are only updated
+    // when someone deletes them. With a partition, only the pods with an
+    // ordinal >= partition are updated.
+    const auto *strategy = data.spec && data.spec->updateStrategy ? &*data.spec->updateStrategy : nullptr;
+    const bool onDelete = strategy && strategy->type == "OnDelete";
+    const size_t partition = strategy && strategy->rollingUpdate ? strategy->rollingUpdate->partition : 0;
+    const size_t toUpdate = onDelete ? 0 : replicas - std::min(partition, replicas);
+
+    LOG_TRACE << "Probe verify: generation = " << generation
+              << ", observedGeneration = " << status.observedGeneration
+              << ", replicas = " << replicas
+              << ", updatedReplicas = " << status.updatedReplicas
+              << " of " << toUpdate
+              << ", readyReplicas = " << status.readyReplicas;
+
+    return generation >= appliedGeneration
+            && static_cast<int64_t>(status.observedGeneration) >= generation
+            && status.updatedReplicas >= toUpdate
+            && status.readyReplicas >= replicas;
+}
+
+} // anon ns
+
 void StatefulSetComponent::prepareDeploy()
 {
     if (!getSpec(true)->template_) {
@@ -68,7 +105,7 @@ void StatefulSetComponent::addRemovementTasks(Component::tasks_t &tasks)
         task.evaluate();
     }, Task::TaskState::PRE, Mode::REMOVE);
 
-    removeTask->addDependency(scaleDownTask);
+    removeTask->addDependency(*scaleDownTask);
     tasks.push_back(removeTask);
 
 
@@ -87,7 +124,7 @@ void StatefulSetComponent::addRemovementTasks(Component::tasks_t &tasks)
         task.evaluate();
     }, Task::TaskState::PRE, Mode::REMOVE);
 
-    removeTask->addDependency(removePvcTask);
+    removeTask->addDependency(*removePvcTask);
     tasks.push_back(removePvcTask);
 
     Component::addRemovementTasks(tasks);
@@ -191,19 +228,12 @@ bool StatefulSetComponent::probe(std::function<void (Component::K8ObjectState)>
                 assert(fn);
                 fn(state);
             }
-            }, [](const auto& data) {
-
-                // TODO: We may have to allow a lower number of replicas to signal ready...
-                const size_t replicas = (data.spec->replicas ? *data.spec->replicas : 1);
-
-                LOG_TRACE << "Probe verify: replicas = " << replicas
-                          << ", readyReplicas = " << (data.status ? to_string(data.status->readyReplicas) : "[null]"s);
-
+            }, [this](const auto& data) {
                 if (Engine::mode() == Engine::Mode::DELETE) {
-                    return data.status->readyReplicas == 0;
+                    return data.status && data.status->readyReplicas == 0;
                 }
 
-                return data.status->readyReplicas == replicas;
+                return isRolledOut(data, appliedGeneration());
             }
         );
     }
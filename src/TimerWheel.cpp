@@ -0,0 +1,170 @@
+#include <algorithm>
+
+#include "k8deployer/TimerWheel.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+TimerWheel::TimerWheel(boost::asio::io_service &io, chrono::milliseconds tick)
+    : tick_{max(tick, chrono::milliseconds{1})}, timer_{io}
+{
+}
+
+TimerWheel::id_t TimerWheel::schedule(chrono::milliseconds delay, TimerWheel::fn_t fn)
+{
+    const auto current = currentTick();
+
+    if (timers_.empty()) {
+        // Nothing pending. Skip ahead, and drop any cancelled timers
+        now_ = max(now_, current);
+        for(auto& level : wheel_) {
+            for(auto& slot : level) {
+                slot.clear();
+            }
+        }
+    }
+
+    // We are somewhere inside the current tick, so add one to never fire early
+    const auto ticks = max<int64_t>(0, (delay.count() + tick_.count() - 1) / tick_.count()) + 1;
+    const auto expires = max(now_, current) + static_cast<uint64_t>(ticks);
+
+    const auto id = ++nextId_;
+    timers_.emplace(id, Timer{expires, move(fn)});
+    place(id, expires);
+    arm();
+    return id;
+}
+
+bool TimerWheel::cancel(TimerWheel::id_t id)
+{
+    // The id is left in it's slot, and ignored when the slot comes up
+    return timers_.erase(id) > 0;
+}
+
+uint64_t TimerWheel::currentTick() const
+{
+    return static_cast<uint64_t>((clock_t::now() - start_) / tick_);
+}
+
+void TimerWheel::place(TimerWheel::id_t id, uint64_t expires)
+{
+    for(unsigned level = 0; level < levels_; ++level) {
+        const auto shift = bits_ * (level + 1);
+        if (level == levels_ - 1 || (expires >> shift) == (now_ >> shift)) {
+            wheel_[level][(expires >> (bits_ * level)) & mask_].push_back(id);
+            return;
+        }
+    }
+}
+
+void TimerWheel::advance(uint64_t toTick)
+{
+    while(now_ < toTick) {
+        if (timers_.empty()) {
+            now_ = toTick;
+            return;
+        }
+        step();
+    }
+}
+
+void TimerWheel::step()
+{
+    ++now_;
+
+    // Move timers down from the levels that wrapped, starting at the top
+    unsigned top = 0;
+    for(unsigned level = 1; level < levels_; ++level) {
+        if ((now_ & ((uint64_t{1} << (bits_ * level)) - 1)) != 0) {
+            break;
+        }
+        top = level;
+    }
+
+    for(auto level = top; level > 0; --level) {
+        cascade(level);
+    }
+
+    auto due = move(wheel_[0][now_ & mask_]);
+    wheel_[0][now_ & mask_].clear();
+
+    for(const auto id : due) {
+        auto it = timers_.find(id);
+        if (it == timers_.end()) {
+            continue; // Cancelled
+        }
+
+        if (it->second.expires > now_) {
+            place(id, it->second.expires);
+            continue;
+        }
+
+        auto fn = move(it->second.fn);
+        timers_.erase(it);
+
+        try {
+            fn();
+        } catch(const exception& ex) {
+            LOG_ERROR << "Caught exception from TimerWheel timer: " << ex.what();
+        }
+    }
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    auto& slot = wheel_[level][(now_ >> (bits_ * level)) & mask_];
+    auto ids = move(slot);
+    slot.clear();
+
+    for(const auto id : ids) {
+        if (auto it = timers_.find(id); it != timers_.end()) {
+            place(id, it->second.expires);
+        }
+    }
+}
+
+void TimerWheel::arm()
+{
+    if (timers_.empty()) {
+        return;
+    }
+
+    // The next non-empty slot at the lowest level, or the next cascade
+    auto next = ((now_ >> bits_) + 1) << bits_;
+    for(auto t = now_ + 1; t < next; ++t) {
+        if (!wheel_[0][t & mask_].empty()) {
+            next = t;
+            break;
+        }
+    }
+
+    if (armedFor_ && armedFor_ <= next) {
+        return;
+    }
+
+    armedFor_ = next;
+    timer_.expires_at(start_ + tick_ * next);
+    timer_.async_wait([this](const auto& ec) {
+        onTimer(ec);
+    });
+}
+
+void TimerWheel::onTimer(const boost::system::error_code &ec)
+{
+    if (ec == boost::asio::error::operation_aborted) {
+        return; // Re-armed
+    }
+
+    armedFor_ = 0;
+
+    if (ec) {
+        LOG_WARN << "TimerWheel: Got error from timer: " << ec.message();
+    }
+
+    advance(currentTick());
+    arm();
+}
+
+} // ns
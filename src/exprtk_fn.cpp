@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
 #include "k8deployer/exprtk_fn.h"
 
 #include "exprtk.hpp"
@@ -7,21 +12,50 @@ namespace k8deployer {
 namespace {
     // http://www.partow.net/programming/exprtk/
     template<typename T>
-    T eval(const std::string& arg) {
-        using expression_t = exprtk::expression<T>;
-        using parser_t = exprtk::parser<T>;
-
-        expression_t expr;
-        parser_t parser;
-        parser.compile(arg, expr);
-        auto result = expr.value();
-        return result;
-    }
+    class ExpressionCache {
+    public:
+        T eval(const std::string& arg, const std::vector<T>& args) {
+            std::lock_guard<std::mutex> lock{mutex_};
+
+            auto& compiled = cache_[arg];
+            if (!compiled) {
+                compiled = std::make_unique<Compiled>();
+
+                // The symbol table refers to the values, so they must not move
+                compiled->args.resize(args.size());
+                for(size_t i = 0; i < args.size(); ++i) {
+                    compiled->symbols.add_variable(exprtkArgName(i), compiled->args[i]);
+                }
+                compiled->expr.register_symbol_table(compiled->symbols);
+                parser_.compile(arg, compiled->expr);
+            }
+
+            std::copy_n(args.begin(), std::min(args.size(), compiled->args.size()), compiled->args.begin());
+            return compiled->expr.value();
+        }
+
+    private:
+        struct Compiled {
+            exprtk::symbol_table<T> symbols;
+            exprtk::expression<T> expr;
+            std::vector<T> args;
+        };
+
+        std::mutex mutex_;
+        exprtk::parser<T> parser_;
+        std::unordered_map<std::string, std::unique_ptr<Compiled>> cache_;
+    };
+}
+
+double exprtkDouble(const std::string &arg, const std::vector<double>& args)
+{
+    static ExpressionCache<double> cache;
+    return cache.eval(arg, args);
 }
 
-double exprtkDouble(const std::string &arg)
+std::string exprtkArgName(size_t ix)
 {
-    return eval<double>(arg);
+    return "k8v" + std::to_string(ix);
 }
 
 } // ns
@@ -55,7 +55,7 @@ int main(int argc, char* argv[]) {
                  "Log-level to use; one of 'info', 'debug', 'trace'")
             ("command,c",
                  po::value<string>(&config.command)->default_value(config.command),
-                 "Comand; one of: 'deploy', 'delete', 'depends'")
+                 "Comand; one of: 'deploy', 'update', 'delete', 'depends', 'simulate'")
             ("storage,s",
                  po::value<string>(&config.storageEngine)->default_value(config.storageEngine),
                  "Storage engine for managed volumes")
@@ -97,6 +97,69 @@ int main(int argc, char* argv[]) {
             ("ignore-resource-limits",
                  po::value<bool>(&config.ignoreResourceLimits)->default_value(config.ignoreResourceLimits),
                  "Do not set resource limits in the container, even if they are declared in the definitions.")
+            ("max-requests-in-flight",
+                 po::value<size_t>(&config.maxRequestsInFlight)->default_value(config.maxRequestsInFlight),
+                 "Upper limit for concurrent requests to each clusters API server. "
+                 "The actual limit adapts to throttling and latency.")
+            ("request-latency-threshold-ms",
+                 po::value<int>(&config.requestLatencyThresholdMs)->default_value(config.requestLatencyThresholdMs),
+                 "Reduce the number of concurrent requests to the API server if requests take longer than this.")
+            ("worker-threads",
+                 po::value<size_t>(&config.workerThreads)->default_value(config.workerThreads),
+                 "Number of worker-threads per cluster for json serialization. "
+                 "0 to do all the work in the clusters io-thread.")
+            ("watch-objects",
+                 po::value<bool>(&config.watchObjects)->default_value(config.watchObjects),
+                 "Track the readiness of Deployments, StatefulSets, DaemonSets, Jobs and PersistentVolumes "
+                 "with watches rather than polling each object.")
+            ("events-field-selector",
+                 po::value<string>(&config.eventsFieldSelector)->default_value(config.eventsFieldSelector),
+                 "Optional fieldSelector for the k8s events we watch, for example `involvedObject.kind=Pod`.")
+            ("watch-timeout-seconds",
+                 po::value<int>(&config.watchTimeoutSeconds)->default_value(config.watchTimeoutSeconds),
+                 "Seconds before the server closes a watch stream. The watch is then resumed. "
+                 "A stream that is silent for 30 seconds longer than this is considered dead.")
+            ("task-timeout-seconds",
+                 po::value<int>(&config.taskTimeoutSeconds)->default_value(config.taskTimeoutSeconds),
+                 "Default deadline for a task, counted from when it starts executing. "
+                 "A task that is not done in time fails. Overridden by the `timeout.seconds` arg. "
+                 "0 to wait forever.")
+            ("skip-unchanged",
+                 po::value<bool>(&config.skipUnchanged)->default_value(config.skipUnchanged),
+                 "Skip objects that are unchanged since the last deploy, by comparing the "
+                 "fingerprint in their `k8dep-hash` annotation.")
+            ("server-side-apply",
+                 po::value<bool>(&config.serverSideApply)->default_value(config.serverSideApply),
+                 "Create or update objects with server-side apply, using the field manager `k8deployer`. "
+                 "If false, objects are created with POST, and objects that already exist fail.")
+            ("delete-mode",
+                 po::value<string>(&config.deleteMode)->default_value(config.deleteMode),
+                 "How `delete` removes objects. 'objects': one by one, in reverse dependency order. "
+                 "'collection': one deletecollection request per kind and namespace, for the objects "
+                 "with our `k8dep-deployment` label. 'namespace': delete the namespaces we manage, "
+                 "and the cluster-scoped objects. 'auto': 'namespace' if all the components are in "
+                 "namespaces we manage, else 'objects'.")
+            ("force-apply",
+                 po::value<bool>(&config.forceApply)->default_value(config.forceApply),
+                 "With server-side apply, take ownership of fields that are managed by others, "
+                 "rather than failing with a conflict.")
+            ("cache-dir",
+                 po::value<string>(&config.cacheDir)->default_value(config.cacheDir),
+                 "Directory for a cache of the parsed definition and kubeconfigs, keyed on their content. "
+                 "Repeated runs with the same files skip the yaml and json parsing.")
+            ("sim-model",
+                 po::value<string>(&config.simModel)->default_value(config.simModel),
+                 "Latency model for the `simulate` command. A file with lines like `Deployment normal 20 5` "
+                 "or `component:mysql fixed 42`. The output from `--save-timings` can be used directly.")
+            ("sim-seed",
+                 po::value<uint64_t>(&config.simSeed)->default_value(config.simSeed),
+                 "Seed for the random latencies in the `simulate` command.")
+            ("sim-runs",
+                 po::value<size_t>(&config.simRuns)->default_value(config.simRuns),
+                 "Number of runs for the `simulate` command. With more than one run, the spread of the makespan is reported.")
+            ("save-timings",
+                 po::value<string>(&config.saveTimings)->default_value(config.saveTimings),
+                 "After `deploy`, save the elapsed time for each task to this file, for use with `--sim-model`.")
             ("variant,V",
                  po::value<decltype(config.variants)>(&config.variants),
                  "Variant override: componentNameRegEx=variant. This argument can be repeated. "
@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <regex>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "yaml-cpp/yaml.h"
+
+#include "k8deployer/yaml_fn.h"
+#include "k8deployer/logging.h"
+
+using namespace std;
+
+namespace k8deployer {
+
+namespace {
+
+// The implicit types in yaml 1.1, as resolved by PyYAML. Base 60 numbers are not supported.
+const regex nullRe{R"(^(?:~|null|Null|NULL|)$)"};
+const regex boolRe{R"(^(?:yes|Yes|YES|no|No|NO|true|True|TRUE|false|False|FALSE|on|On|ON|off|Off|OFF)$)"};
+const regex intRe{R"(^(?:[-+]?0b[0-1_]+|[-+]?0[0-7_]+|[-+]?(?:0|[1-9][0-9_]*)|[-+]?0x[0-9a-fA-F_]+)$)"};
+const regex floatRe{R"(^(?:[-+]?(?:[0-9][0-9_]*)\.[0-9_]*(?:[eE][-+][0-9]+)?|[-+]?\.[0-9][0-9_]*(?:[eE][-+][0-9]+)?)$)"};
+
+void appendString(string& out, const string& value)
+{
+    static constexpr char hex[] = "0123456789abcdef";
+
+    out += '"';
+    for(const auto ch : value) {
+        switch(ch) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\b':
+            out += "\\b";
+            break;
+        case '\f':
+            out += "\\f";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(ch) < 0x20) {
+                out += "\\u00";
+                out += hex[(ch >> 4) & 0xf];
+                out += hex[ch & 0xf];
+            } else {
+                out += ch;
+            }
+        }
+    }
+    out += '"';
+}
+
+string removeUnderscores(string value)
+{
+    value.erase(remove(value.begin(), value.end(), '_'), value.end());
+    return value;
+}
+
+string toJsonInt(const string& value)
+{
+    auto digits = removeUnderscores(value);
+    string sign;
+    if (digits[0] == '-' || digits[0] == '+') {
+        if (digits[0] == '-') {
+            sign = "-";
+        }
+        digits = digits.substr(1);
+    }
+
+    int base = 10;
+    if (digits.size() > 1 && digits[0] == '0') {
+        if (digits[1] == 'x') {
+            base = 16;
+            digits = digits.substr(2);
+        } else if (digits[1] == 'b') {
+            base = 2;
+            digits = digits.substr(2);
+        } else {
+            base = 8;
+        }
+    }
+
+    if (base == 10) {
+        return sign + digits;
+    }
+
+    return sign + to_string(stoull(digits, nullptr, base));
+}
+
+string toJsonFloat(const string& value)
+{
+    auto number = removeUnderscores(value);
+    if (number[0] == '+') {
+        number = number.substr(1);
+    }
+
+    // Json needs digits on both sides of the dot
+    const auto dot = number.find('.');
+    if (dot == 0 || (dot == 1 && number[0] == '-')) {
+        number.insert(dot, "0");
+    }
+    if (const auto dot = number.find('.'); dot + 1 == number.size()
+            || number[dot + 1] == 'e' || number[dot + 1] == 'E') {
+        number.insert(dot + 1, "0");
+    }
+
+    return number;
+}
+
+// Returns true if the scalar is a string
+bool resolve(const string& value, bool plain, string& out)
+{
+    if (!plain) {
+        out = value;
+        return true;
+    }
+
+    if (regex_match(value, nullRe)) {
+        out = "null";
+    } else if (regex_match(value, boolRe)) {
+        const auto ch = value[0];
+        out = (ch == 'y' || ch == 'Y' || ch == 't' || ch == 'T' || value == "on" || value == "On" || value == "ON")
+                ? "true" : "false";
+    } else if (regex_match(value, intRe)) {
+        out = toJsonInt(value);
+    } else if (regex_match(value, floatRe)) {
+        out = toJsonFloat(value);
+    } else {
+        out = value;
+        return true;
+    }
+
+    return false;
+}
+
+// Quoted and block scalars are strings. So is anything explicitly tagged as that.
+bool isPlain(const YAML::Node& node)
+{
+    const auto& tag = node.Tag();
+    return tag != "!" && tag != "tag:yaml.org,2002:str";
+}
+
+void appendScalar(const YAML::Node& node, string& out, bool isKey, const yaml_scalar_hook_t& hook)
+{
+    const auto plain = isPlain(node);
+    if (hook && hook(out, node.Scalar(), plain, isKey)) {
+        return;
+    }
+
+    appendYamlScalar(out, node.Scalar(), plain, isKey);
+}
+
+void appendKey(const YAML::Node& key, string& out, const yaml_scalar_hook_t& hook)
+{
+    if (key.IsScalar()) {
+        appendScalar(key, out, true, hook);
+    } else if (key.IsNull()) {
+        out += "\"null\"";
+    } else {
+        throw runtime_error{"Only scalar keys can be converted to json"};
+    }
+}
+
+bool isMergeKey(const YAML::Node& key)
+{
+    return key.IsScalar() && key.Scalar() == "<<" && isPlain(key);
+}
+
+bool hasMergeKey(const YAML::Node& node)
+{
+    for(const auto& item : node) {
+        if (isMergeKey(item.first)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+using entries_t = vector<pair<string, YAML::Node>>;
+
+/*! Flatten a map with merge keys (`<<: *base`), like PyYAML does
+ *
+ * The maps own keys win, then the merged maps in the order they are listed.
+ */
+void collectEntries(const YAML::Node& node, entries_t& entries, set<string>& seen,
+                    bool merged, const yaml_scalar_hook_t& hook)
+{
+    vector<YAML::Node> merges;
+    for(const auto& item : node) {
+        if (isMergeKey(item.first)) {
+            if (item.second.IsMap()) {
+                merges.push_back(item.second);
+            } else if (item.second.IsSequence()) {
+                for(const auto& m : item.second) {
+                    if (!m.IsMap()) {
+                        throw runtime_error{"A merge key (<<) must refer to a map or a sequence of maps"};
+                    }
+                    merges.push_back(m);
+                }
+            } else {
+                throw runtime_error{"A merge key (<<) must refer to a map or a sequence of maps"};
+            }
+            continue;
+        }
+
+        string key;
+        appendKey(item.first, key, hook);
+        if (seen.insert(key).second) {
+            entries.emplace_back(move(key), item.second);
+        } else if (!merged) {
+            // Like json, the last of the maps own keys wins
+            for(auto& entry : entries) {
+                if (entry.first == key) {
+                    entry.second = item.second;
+                    break;
+                }
+            }
+        }
+    }
+
+    for(const auto& m : merges) {
+        collectEntries(m, entries, seen, true, hook);
+    }
+}
+
+void toJson(const YAML::Node& node, string& out, const yaml_scalar_hook_t& hook)
+{
+    switch(node.Type()) {
+    case YAML::NodeType::Undefined:
+    case YAML::NodeType::Null:
+        out += "null";
+        break;
+    case YAML::NodeType::Scalar:
+        appendScalar(node, out, false, hook);
+        break;
+    case YAML::NodeType::Sequence: {
+        out += '[';
+        bool first = true;
+        for(const auto& item : node) {
+            if (!first) {
+                out += ',';
+            }
+            first = false;
+            toJson(item, out, hook);
+        }
+        out += ']';
+    } break;
+    case YAML::NodeType::Map: {
+        out += '{';
+        bool first = true;
+        if (hasMergeKey(node)) {
+            entries_t entries;
+            set<string> seen;
+            collectEntries(node, entries, seen, false, hook);
+            for(const auto& [key, value] : entries) {
+                if (!first) {
+                    out += ',';
+                }
+                first = false;
+                out += key;
+                out += ':';
+                toJson(value, out, hook);
+            }
+        } else {
+            for(const auto& item : node) {
+                if (!first) {
+                    out += ',';
+                }
+                first = false;
+                appendKey(item.first, out, hook);
+                out += ':';
+                toJson(item.second, out, hook);
+            }
+        }
+        out += '}';
+    } break;
+    }
+}
+
+} // anon ns
+
+void appendYamlScalar(string &out, const string &value, bool plain, bool isKey)
+{
+    string resolved;
+    // Json keys are strings, whatever the yaml key resolved to
+    if (resolve(value, plain, resolved) || isKey) {
+        appendString(out, resolved);
+    } else {
+        out += resolved;
+    }
+}
+
+string yamlToJson(const string &yaml, const string &name, const yaml_scalar_hook_t& hook)
+{
+    try {
+        const auto root = YAML::Load(yaml);
+        string json;
+        json.reserve(yaml.size() + yaml.size() / 4);
+        toJson(root, json, hook);
+        return json;
+    } catch(const exception& ex) {
+        LOG_ERROR << "Failed to convert yaml from " << name << ": " << ex.what();
+        throw runtime_error("Failed to convert yaml: "s + name);
+    }
+}
+
+} // ns